@@ -18,14 +18,39 @@
 #include <cmath>
 #include <math.h>
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <errno.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
+/**
+ * Number of threads the parallel loops will use, 1 without OpenMP.
+ */
+static int numThreads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
 /**
  * Default constructor.
  */ 
 Image::Image() {
   image = NULL;
+  stride = 0;
+  mapping = NULL;
+  mappingSize = 0;
+  borrowed = false;
   nrows = 0;
   ncols = 0;
   maximum = 255;
@@ -44,9 +69,40 @@ Image::Image(int nRows, int nCols) {
     exit(3);
   }
   image = NULL;
+  mapping = NULL;
+  mappingSize = 0;
+  borrowed = false;
   createImage(nRows, nCols);
 }
 
+/**
+ * Constructor that wraps a buffer owned by someone else (for example a
+ * NumPy array, or another image for view()). The pixels are not copied and
+ * the buffer is not freed by the destructor, so it has to outlive the image.
+ * @param nRows Numbers of rows (height).
+ * @param nCols Number of columns (width).
+ * @param buffer First pixel, rows are stored one after the other.
+ * @param rowStride Floats between the starts of two rows, 0 for nCols;
+ *        negative when the rows are stored bottom to top.
+ * @return The created image.
+ */
+Image::Image(int nRows, int nCols, float *buffer, int rowStride) {
+  if (rowStride == 0)
+    rowStride = nCols;
+  if (nRows<=0 || nCols<=0 || buffer == NULL || abs(rowStride) < nCols) {
+    cout << "Image: Index out of range.\n";
+    exit(3);
+  }
+  nrows = nRows;
+  ncols = nCols;
+  stride = rowStride;
+  maximum = 255;
+  image = buffer;
+  mapping = NULL;
+  mappingSize = 0;
+  borrowed = true;
+}
+
 /**
  * Copy constructor. 
  * @param img Copy image.
@@ -56,21 +112,40 @@ Image::Image(const Image &img) {
   int rows, cols;
 
   image = NULL;
+  mapping = NULL;
+  mappingSize = 0;
+  borrowed = false;
   nrows = img.getRow();
   ncols = img.getCol();
   createImage(nrows, ncols);             // allocate memory
   
   for (rows=0; rows < nrows; rows++)
     for (cols=0; cols < ncols; cols++)
-		image[rows * ncols + cols] = img(rows, cols);
+		image[rows * stride + cols] = img(rows, cols);
 }
 
 /**
  * Destructor.  Frees memory.
  */
 Image::~Image() {
-  if (image)
-    delete [] image;       // free the image buffer
+  freeImage();             // free the image buffer
+}
+
+/**
+ * Frees the image buffer. A buffer that was mapped from a file by
+ * readFloatImage() is unmapped, a borrowed buffer is left alone and any
+ * other buffer is deleted.
+ */
+void Image::freeImage() {
+  if (mapping != NULL)
+    munmap(mapping, mappingSize);
+  else if (image != NULL && !borrowed)
+    delete [] image;
+
+  image = NULL;
+  mapping = NULL;
+  mappingSize = 0;
+  borrowed = false;
 }
 
 
@@ -83,8 +158,7 @@ Image::~Image() {
  */
 void Image::createImage() {
 
-  if (image != NULL)
-    delete [] image;
+  freeImage();
 
   maximum = 255;
 
@@ -93,6 +167,7 @@ void Image::createImage() {
     cout << "CREATEIMAGE: Out of memory.\n";
     exit(1);
   }
+  stride = ncols;
 
   initImage();
 }
@@ -105,8 +180,7 @@ void Image::createImage() {
  */
 void Image::createImage(int numberOfRows, int numberOfColumns) {
   
-  if (image != NULL)
-    delete [] image;
+  freeImage();
 
   nrows = numberOfRows;
   ncols = numberOfColumns;
@@ -117,6 +191,7 @@ void Image::createImage(int numberOfRows, int numberOfColumns) {
     cout << "CREATEIMAGE: Out of memory.\n";
     exit(1);
   }
+  stride = ncols;
 
   initImage();
 }
@@ -126,10 +201,11 @@ void Image::createImage(int numberOfRows, int numberOfColumns) {
  * @para init The value the image is initialized to. Default is 0.0.
  */
 void Image::initImage(float initialValue) {
-  int i;
+  int rows, cols;
 
-  for (i = 0; i < nrows * ncols; i++)
-    image[i] = initialValue;
+  for (rows = 0; rows < nrows; rows++)
+    for (cols = 0; cols < ncols; cols++)
+      image[rows * stride + cols] = initialValue;
 }
 
 /**
@@ -150,6 +226,16 @@ int Image::getCol() const {
   return ncols;
 }
 
+/**
+ * Returns the distance between the starts of two rows in the buffer. It
+ * equals the width except for views.
+ * @return Row stride in pixels.
+ * \ingroup getset
+ */
+int Image::getStride() const {
+  return stride;
+}
+
 /**
  * Returns the maximum pixel value of a gray-level image. 
  * @return The intensity of that pixel.
@@ -162,8 +248,8 @@ float Image::getMaximum() const {
  
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-      if (maxi < image[i*ncols+j])
-	maxi = image[i*ncols+j];
+      if (maxi < image[i*stride+j])
+	maxi = image[i*stride+j];
   
   return maxi;
 }
@@ -180,21 +266,65 @@ float Image::getMinimum() const {
 
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-      if (mini > image[i*ncols+j])
-	mini = image[i*ncols+j];
+      if (mini > image[i*stride+j])
+	mini = image[i*stride+j];
 
   return mini;
 }
 
 
 
+/**
+ * Returns a 64-bit hash of the size and the pixel bits, for recognizing an
+ * image that was seen before (see ResultCache). The rows are hashed in
+ * parallel, two pixels per multiply, and the row hashes are folded in
+ * order, so the value does not depend on the number of threads or on the
+ * stride.
+ * @return The hash.
+ * \ingroup getset
+ */
+uint64_t Image::hash() const {
+  const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+  vector<uint64_t> rowHash(nrows);
+  uint64_t h;
+  int rows;
+
+#pragma omp parallel for
+  for (rows = 0; rows < nrows; rows++) {
+    const float *p = &image[(long) rows * stride];
+    uint64_t r = (rows + 1) * prime, w;
+    int cols;
+
+    for (cols = 0; cols + 1 < ncols; cols += 2) {
+      memcpy(&w, &p[cols], sizeof(w));
+      r = (r ^ w) * prime;
+      r ^= r >> 29;
+    }
+    if (cols < ncols) {
+      uint32_t last;
+      memcpy(&last, &p[cols], sizeof(last));
+      r = (r ^ last) * prime;
+      r ^= r >> 29;
+    }
+    rowHash[rows] = r;
+  }
+
+  h = ((uint64_t) nrows << 32 | (uint32_t) ncols) * prime;
+  for (rows = 0; rows < nrows; rows++) {
+    h = (h ^ rowHash[rows]) * 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+  }
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  return h ^ (h >> 33);
+}
+
 /**
  * Returns the pixel value at rows, cols
  * @return The pixel value
  * \ingroup getset
  */
 float Image::getPix(int rows, int cols) {
-  return image[rows * ncols + cols];
+  return image[rows * stride + cols];
 }
 
 
@@ -210,7 +340,7 @@ Image Image::getImage() const {
   temp.createImage(nrows, ncols);   // temp is a gray-scale image
   for (rows = 0; rows < nrows; rows++)
     for (cols = 0; cols < ncols; cols++)
-      temp(rows, cols) = image[rows * ncols + cols];
+      temp(rows, cols) = image[rows * stride + cols];
       
   return temp;
 }
@@ -240,7 +370,7 @@ void Image::setCol(int numberOfColumns) {
  * \ingroup getset
  */
 void Image::setPix(int rows, int cols, float value) {
-  image[rows * ncols + cols] = value;
+  image[rows * stride + cols] = value;
 }
 
 
@@ -253,7 +383,28 @@ void Image::setImage(Image &img) {
 
   for (rows = 0; rows < nrows; rows++)
     for (cols = 0; cols < ncols; cols++)
-      image[rows * ncols + cols] = img(rows, cols);
+      image[rows * stride + cols] = img(rows, cols);
+}
+
+/**
+ * Returns a view of a rectangular part of the image. The view shares the
+ * pixels of this image, nothing is copied: writing into the view (with
+ * setPix, operator(), setImage or by assigning an image of the same size to
+ * it) changes this image. The view must not outlive this image.
+ * @param row Top row of the window.
+ * @param col Left column of the window.
+ * @param height Number of rows of the window.
+ * @param width Number of columns of the window.
+ * @return The view.
+ * \ingroup getset
+ */
+Image Image::view(int row, int col, int height, int width) {
+  if (row < 0 || col < 0 || height <= 0 || width <= 0 ||
+      row + height > nrows || col + width > ncols) {
+    cout << "view: Window is outside the image.\n";
+    exit(3);
+  }
+  return Image(height, width, &image[row * stride + col], stride);
 }
 
 /**
@@ -263,7 +414,7 @@ void Image::setImage(Image &img) {
  * @param j Column
  */
 float & Image::operator()(int rows, int cols) const {
-  return image[rows * ncols + cols];
+  return image[rows * stride + cols];
 }
 
 /**
@@ -278,9 +429,12 @@ const Image Image::operator=(const Image& img) {
   if (this == &img)
     return *this;
 
-  nrows = img.getRow();
-  ncols = img.getCol();
-  createImage(nrows, ncols);             
+  // a view of the same size is written through, anything else is replaced
+  if (!borrowed || img.getRow() != nrows || img.getCol() != ncols) {
+    nrows = img.getRow();
+    ncols = img.getCol();
+    createImage(nrows, ncols);
+  }
 
   for (rows = 0; rows < nrows; rows++)
     for (cols = 0; cols < ncols; cols++)
@@ -311,7 +465,7 @@ Image Image::operator+(const Image& img) const {
   
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-        temp(i,j) = image[i*ncols+j] + img(i,j);
+        temp(i,j) = image[i*stride+j] + img(i,j);
 
   return temp;
 }
@@ -338,7 +492,7 @@ Image Image::operator-(const Image &img) const {
   
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-        temp(i,j) = image[i*ncols+j] - img(i,j);
+        temp(i,j) = image[i*stride+j] - img(i,j);
 
   return temp;
 }
@@ -365,7 +519,7 @@ Image Image::operator*(const Image &img) const {
   
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-        temp(i,j) = image[i*ncols+j] * img(i,j);
+        temp(i,j) = image[i*stride+j] * img(i,j);
 
   return temp;
 }
@@ -393,11 +547,94 @@ Image Image::operator/(const Image &img) const {
   
   for (i=0; i<nrows; i++)
     for (j=0; j<ncols; j++)
-        temp(i,j) = image[i*ncols+j] / ( img(i,j) + 0.001 );
+        temp(i,j) = image[i*stride+j] / ( img(i,j) + 0.001 );
 
   return temp;
 }
 
+/**
+ * Overloading += operator. Adds img to the image in place, so no
+ * temporary image is created.
+ * \ingroup overload
+ * @param img Image to add to specified image.
+ * @return The image itself.
+ */
+Image & Image::operator+=(const Image &img) {
+  int i, j;
+
+  if (img.getRow() != nrows || img.getCol() != ncols) {
+    cout << "operator+=: "
+         << "Images are not of the same size or type, can't do addition\n";
+    exit(3);
+  }
+
+  for (i=0; i<nrows; i++)
+    for (j=0; j<ncols; j++)
+        image[i*stride+j] += img(i,j);
+
+  return *this;
+}
+
+/**
+ * Overloading -= operator. Subtracts img from the image in place.
+ * \ingroup overload
+ * @param img Image to subtract from specified image.
+ * @return The image itself.
+ */
+Image & Image::operator-=(const Image &img) {
+  int i, j;
+
+  if (img.getRow() != nrows || img.getCol() != ncols) {
+    cout << "operator-=: "
+         << "Images are not of the same size or type, can't do subtraction\n";
+    exit(3);
+  }
+
+  for (i=0; i<nrows; i++)
+    for (j=0; j<ncols; j++)
+        image[i*stride+j] -= img(i,j);
+
+  return *this;
+}
+
+/**
+ * Overloading *= operator. Pixel by pixel multiplication in place.
+ * \ingroup overload
+ * @param img Image to multiply with specified image.
+ * @return The image itself.
+ */
+Image & Image::operator*=(const Image &img) {
+  int i, j;
+
+  if (img.getRow() != nrows || img.getCol() != ncols) {
+    cout << "operator*=: "
+         << "Images are not of the same size or type, can't do multiplication\n";
+    exit(3);
+  }
+
+  for (i=0; i<nrows; i++)
+    for (j=0; j<ncols; j++)
+        image[i*stride+j] *= img(i,j);
+
+  return *this;
+}
+
+/**
+ * Overloading *= operator. Multiplies every pixel by a scalar in place.
+ * \ingroup overload
+ * @param s A double point number.
+ * @return The image itself.
+ */
+Image & Image::operator*=(double s) {
+  int i, j;
+
+  for (i=0; i<nrows; i++)
+    for (j=0; j<ncols; j++)
+        image[i*stride+j] *= s;
+
+  return *this;
+}
+
 
 /**
  * Overloading << operator.  Output the image to the specified destination.
@@ -519,20 +756,21 @@ Image operator-(Image &img, double s) {
 /**
  * Read image from a file                     
  * @param fname The name of the file 
- * @return An Image object
+ * @return true on success; false, after a message, when the file can't be
+ *         read or is not an 8-bit PGM. The image is unchanged then.
  */
-  void Image::readImage(char *fname) {
+bool Image::readImage(char *fname) {
   ifstream ifp;
   char dummy[80];
   unsigned char *img;
   int rows, cols;
-  int nRows, nCols, nt, maxi;
+  int nRows, nCols, maxi;
 
   ifp.open(fname, ios::in | ios::binary);
 
   if (!ifp) {
     cout << "readImage: Can't read image: " << fname << endl;
-    exit(1);
+    return false;
   }
 
   // identify image format
@@ -542,73 +780,77 @@ Image operator-(Image &img, double s) {
      ;
   else {
     cout << "readImage: Can't identify image format." << endl;
-    exit(1);
+    return false;
   }
 
   // skip the comments
   ifp.getline(dummy, 80, '\n');
 
-  while (dummy[0] == '#') {
+  while (ifp && dummy[0] == '#') {
     ifp.getline(dummy, 80, '\n');
   }
 
   // read the row number and column number
-  sscanf(dummy, "%d %d", &nCols, &nRows);
+  if (sscanf(dummy, "%d %d", &nCols, &nRows) != 2 || nRows <= 0 || nCols <= 0) {
+    cout << "readImage: Can't read image header." << endl;
+    return false;
+  }
 
   // read the maximum pixel value
   ifp.getline(dummy, 80, '\n');
-  sscanf(dummy, "%d", &maxi); 
+  if (sscanf(dummy, "%d", &maxi) != 1) {
+    cout << "readImage: Can't read image header." << endl;
+    return false;
+  }
   if (maxi > 255) {
     cout << "Don't know what to do: maximum value is over 255.\n";
-    exit(1);
+    return false;
+  }
+
+  // read the image data
+  img = (unsigned char *) new unsigned char [nRows * nCols];
+  ifp.read((char *)img, (nRows * nCols * sizeof(unsigned char)));
+  if (ifp.gcount() != nRows * nCols) {
+    cout << "readImage: File is shorter than its header says.\n";
+    delete [] img;
+    return false;
   }
+  ifp.close();
 
-  if (image != NULL)
-  delete [] image;
+  freeImage();
   
   nrows = nRows;
   ncols = nCols;
+  stride = nCols;
   maximum = 255;
   
-  // read the image data
-  img = (unsigned char *) new unsigned char [nRows * nCols];
-  if (!img) {
-    cout << "READIMAGE: Out of memory.\n";
-    exit(1);
-  }
   image = (float *) new float [nRows * nCols];
-  if (!image) {
-    cout << "READIMAGE: Out of memory.\n";
-    exit(1);
-  }
-
-    ifp.read((char *)img, (nRows * nCols * sizeof(unsigned char)));
     
     for (rows = 0; rows < nRows; rows++)
       for (cols = 0; cols < nCols; cols++)
           image[rows * nCols + cols] = (float) img[rows * nCols + cols];
-      
-  ifp.close();
   
   delete [] img;
+  return true;
 }
 
 
 /**
  * Write image buffer to a file.
  * @param fname The output file name.
+ * @return true on success; false, after a message, when the file can't be
+ *         written.
  */
-void Image::writeImage(char *fname, bool flag) {
+bool Image::writeImage(char *fname, bool flag) {
   ofstream ofp;
   int i, j;
-  int nRows, nCols, nt;
   unsigned char *img;
 
   ofp.open(fname, ios::out | ios::binary);
 
   if (!ofp) {
     cout << "writeImage: Can't write image: " << fname << endl;
-    exit(1);
+    return false;
   }
 
 
@@ -622,10 +864,6 @@ void Image::writeImage(char *fname, bool flag) {
 
   // convert the image data type back to unsigned char
   img = (unsigned char *) new unsigned char [nrows * ncols];
-  if (!img) {
-    cout << "WRITEIMAGE: Out of memory.\n";
-    exit(1);
-  }
 
   float maxi = getMaximum();
   float mini = getMinimum();
@@ -635,14 +873,14 @@ void Image::writeImage(char *fname, bool flag) {
       for (j = 0; j < ncols; j++) {
 	  // rescale if the flag is set
 	  if ((maxi != mini) && flag == true)
-	    img[i * ncols + j] = (unsigned char)  ((image[i * ncols + j]-mini)/(float)(maxi-mini)*255.0); 
+	    img[i * ncols + j] = (unsigned char)  ((image[i * stride + j]-mini)/(float)(maxi-mini)*255.0); 
 	  // any intensity that is larger than the maximum would be set as maximum
-	  else if (image[i * ncols + j] > 255)
+	  else if (image[i * stride + j] > 255)
 	    img[i * ncols + j] = 255;
-	  else if (image[i * ncols + j] < 0)
+	  else if (image[i * stride + j] < 0)
 	    img[i * ncols + j] = 0;
 	  else
-	    img[i * ncols + j] = (unsigned char)  image[i * ncols + j]; 
+	    img[i * ncols + j] = (unsigned char)  image[i * stride + j]; 
       }
       
     ofp.write((char *)img, (nrows * ncols * sizeof(unsigned char)));
@@ -650,9 +888,256 @@ void Image::writeImage(char *fname, bool flag) {
 
   ofp.close();
   delete [] img;
+
+  if (!ofp) {
+    cout << "writeImage: Can't write image: " << fname << endl;
+    return false;
+  }
+  return true;
+}
+
+
+
+
+// first line of the metadata trailer of the float images
+#define PFM_TRAILER "# img_process metadata\n"
+
+/**
+ * Writes the buffers of iov to fd, IOV_MAX of them per writev() call,
+ * carrying on after short writes.
+ */
+static bool writeBuffers(int fd, struct iovec *iov, int count) {
+  while (count > 0 && iov->iov_len == 0) {
+    iov++;
+    count--;
+  }
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, min(count, IOV_MAX));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    while (count > 0 && (size_t) n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+/**
+ * Write the float image buffer to a file without any quantization, as a
+ * standard little-endian single channel PFM: "Pf", the width and height,
+ * the scale -1 and one newline, then the rows from the bottom one up. The
+ * number of zeros in the scale ("-1.0", "-1.00", ...) is chosen so that
+ * the pixel data starts at a multiple of 4 bytes, which lets
+ * readFloatImage() map the file instead of copying it.
+ *
+ * The metadata goes after the pixel data, where PFM readers stop reading:
+ * a line "# img_process metadata", a line "maximum <value>", then the
+ * caller's text. The file stays a plain PFM to every other reader.
+ *
+ * Everything goes out through writev(), so the rows are gathered in file
+ * order without copying them. An image read through readFloatImage() is
+ * already stored bottom to top and goes out as one buffer; a top-down
+ * image needs one buffer per row, IOV_MAX of them per call.
+ * @param fname The output file name.
+ * @param prefix Bytes written ahead of the PFM, for callers that keep
+ *        their own header in the file; the padding counts them too.
+ * @param metadata Text stored after the pixel data.
+ * @return true on success; false, after a message, when the file can't be
+ *         written.
+ */
+bool Image::writeFloatImage(char *fname, const string &prefix, const string &metadata) {
+  ostringstream header, trailer;
+  string head, tail;
+  vector<struct iovec> iov;
+  struct iovec v;
+  int fd, rows;
+  bool ok;
+
+  header << "Pf\n" << ncols << " " << nrows << "\n-1.0";
+  head = header.str();
+  while ((prefix.size() + head.size() + 1) % sizeof(float) != 0)
+    head += "0";
+  head += "\n";
+
+  trailer << PFM_TRAILER << "maximum " << setprecision(9) << maximum << "\n" << metadata;
+  tail = trailer.str();
+
+  v.iov_base = (void *) prefix.data();
+  v.iov_len = prefix.size();
+  iov.push_back(v);
+  v.iov_base = (void *) head.data();
+  v.iov_len = head.size();
+  iov.push_back(v);
+  if (stride == -ncols) {
+    v.iov_base = &image[(long)(nrows - 1) * stride];
+    v.iov_len = (size_t)nrows * ncols * sizeof(float);
+    iov.push_back(v);
+  }
+  else
+    for (rows = nrows - 1; rows >= 0; rows--) {
+      v.iov_base = &image[(long)rows * stride];
+      v.iov_len = ncols * sizeof(float);
+      iov.push_back(v);
+    }
+  v.iov_base = (void *) tail.data();
+  v.iov_len = tail.size();
+  iov.push_back(v);
+
+  fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cout << "writeFloatImage: Can't write image: " << fname << endl;
+    return false;
+  }
+  ok = writeBuffers(fd, &iov[0], iov.size());
+  if (close(fd) != 0)
+    ok = false;
+  if (!ok) {
+    cout << "writeFloatImage: Can't write image: " << fname << endl;
+    return false;
+  }
+  return true;
 }
 
 
+/**
+ * Read a single channel PFM. When the file is little-endian and its pixel
+ * data starts at a multiple of 4 bytes (always the case for files written
+ * by writeFloatImage()), the file is mapped into memory and the mapping
+ * becomes the image buffer: the rows stay in the file's bottom-to-top order
+ * and the image walks them with a negative stride, so nothing is copied.
+ * The mapping is private, so changing pixels never touches the file. Other
+ * files are copied (flipped, and byte-swapped if big-endian) into a normal
+ * buffer. The metadata trailer of writeFloatImage() restores the maximum;
+ * a file without one gets 255.
+ * @param fname The name of the file
+ * @param start Byte at which the PFM starts, past a caller's own header
+ *        (see writeFloatImage()).
+ * @param metadata If not NULL, set to the caller's text of the trailer,
+ *        empty when the file has none.
+ * @return true on success; false, after a message, when the file can't be
+ *         read or is not a single channel PFM. The image is unchanged then.
+ */
+bool Image::readFloatImage(char *fname, size_t start, string *metadata) {
+  int fd;
+  struct stat st;
+  char *base, *p, *end;
+  long nRows, nCols;
+  float scale;
+  int rows;
+  size_t offset, dataEnd;
+  float maxi = 255;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    cout << "readFloatImage: Can't read image: " << fname << endl;
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+
+  base = (char *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    cout << "readFloatImage: Can't map image: " << fname << endl;
+    return false;
+  }
+  end = base + st.st_size;
+
+  // identify image format
+  p = base + start;
+  if (start + 3 > (size_t)st.st_size || p[0] != 'P' || p[1] != 'f' || !isspace(p[2])) {
+    cout << "readFloatImage: Can't identify image format." << endl;
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  // width, height and scale, separated by whitespace and maybe comments;
+  // exactly one whitespace character follows the scale
+  p += 2;
+  nCols = nRows = 0;
+  scale = 0;
+  for (int field = 0; field < 3; field++) {
+    while (p < end && (isspace(*p) || *p == '#')) {
+      if (*p == '#')
+        while (p < end && *p != '\n')
+          p++;
+      else
+        p++;
+    }
+    string token;
+    while (p < end && !isspace(*p))
+      token += *p++;
+    if (field == 0)
+      nCols = atol(token.c_str());
+    else if (field == 1)
+      nRows = atol(token.c_str());
+    else
+      scale = atof(token.c_str());
+  }
+  offset = p + 1 - base;
+
+  if (nRows <= 0 || nCols <= 0 || scale == 0 || p >= end) {
+    cout << "readFloatImage: Can't read image header." << endl;
+    munmap(base, st.st_size);
+    return false;
+  }
+  dataEnd = offset + (size_t)nRows * nCols * sizeof(float);
+  if (dataEnd > (size_t)st.st_size) {
+    cout << "readFloatImage: File is shorter than its header says.\n";
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  // metadata trailer behind the pixel data
+  if (metadata != NULL)
+    metadata->clear();
+  p = base + dataEnd;
+  if ((size_t)(end - p) >= strlen(PFM_TRAILER) && memcmp(p, PFM_TRAILER, strlen(PFM_TRAILER)) == 0) {
+    p += strlen(PFM_TRAILER);
+    char *eol = (char *) memchr(p, '\n', end - p);
+    if (eol != NULL && eol - p > 8 && memcmp(p, "maximum ", 8) == 0) {
+      maxi = atof(string(p + 8, eol).c_str());
+      p = eol + 1;
+    }
+    if (metadata != NULL)
+      metadata->assign(p, end);
+  }
+
+  freeImage();
+
+  nrows = nRows;
+  ncols = nCols;
+  maximum = maxi;
+
+  if (scale < 0 && offset % sizeof(float) == 0) {
+    mapping = base;
+    mappingSize = st.st_size;
+    stride = -ncols;
+    image = (float *) (base + offset) + (long)(nrows - 1) * ncols;
+    return true;
+  }
+
+  stride = ncols;
+  image = (float *) new float [(size_t)nrows * ncols];
+  for (rows = 0; rows < nrows; rows++) {
+    char *dst = (char *) &image[(long)(nrows - 1 - rows) * ncols];
+    memcpy(dst, base + offset + (size_t)rows * ncols * sizeof(float), ncols * sizeof(float));
+    if (scale > 0)                              // big-endian file
+      for (int k = 0; k < ncols; k++)
+        reverse(dst + k * sizeof(float), dst + (k + 1) * sizeof(float));
+  }
+
+  munmap(base, st.st_size);
+  return true;
+}
 
 
 // YOUR FUNCTIONS
@@ -669,7 +1154,7 @@ Image Image::thresholdImage(float thresholdValue, float lowValue, float highValu
   temp.createImage(nrows, ncols);   // temp is a gray-scale image
   for (rows = 0; rows < nrows; rows++)
     for (cols = 0; cols < ncols; cols++)
-      if (image[rows * ncols + cols] <= thresholdValue) 
+      if (image[rows * stride + cols] <= thresholdValue) 
 	temp(rows, cols) = lowValue;
       else
 	temp(rows, cols) = highValue;
@@ -872,13 +1357,14 @@ Image Image::DFT(){
     }
   }
 
-  for(cols = 0; cols < ncols; cols++){ //sütun için
-    for(rows = 0; rows < nrows; rows++){ //satır için
-      
+  // column pass, rows outer so that memory is walked in order
+  for(rows = 0; rows < nrows; rows++){ //satır için
+    for(cols = 0; cols < ncols; cols++){ //sütun için
+
       r = Image::getPix(rows, cols); //satır ve sütundaki piksel değerleri alındı
 
       temp(rows, cols) += abs(r * (cos(2 * PI * (1.0 * rows * cols / ncols)) -  sin(2 * PI * (1.0 * rows * cols / ncols))) ) ; // DFT formülü sin cos olarak uygulandı
-      
+
     }
   }
 
@@ -906,16 +1392,1755 @@ Image Image::IDFT(){
     }
   }
 
-  for(cols = 0; cols < ncols; cols++){ //sütun için
-    for(rows = 0; rows < nrows; rows++){ //satır için
-      
+  // column pass, rows outer as in DFT()
+  for(rows = 0; rows < nrows; rows++){ //satır için
+    for(cols = 0; cols < ncols; cols++){ //sütun için
+
       r = Image::getPix(rows, cols); //satır ve sütundaki piksel değerleri alındı
 
       temp(rows, cols) += (1/ncols) * abs(r * (cos(2 * PI * (1.0 * rows * cols / ncols)) -  sin(2 * PI * (1.0 * rows * cols / ncols))) ) ; // IDFT formülü sin cos olarak uygulandı
-      
+
     }
   }
 
 return temp; //görüntü döndürüldü
 
-}
\ No newline at end of file
+}
+
+
+/**
+ * Transposes the image. The copy is done one TILESIZE x TILESIZE block at a
+ * time so that both the reads and the strided writes stay in cache.
+ * @return The transposed (ncols x nrows) image.
+ */
+Image Image::transpose() {
+  Image temp;
+  int rows, cols, tr, tc;
+
+  temp.createImage(ncols, nrows);
+
+  for (tr = 0; tr < nrows; tr += TILESIZE)
+    for (tc = 0; tc < ncols; tc += TILESIZE)
+      for (rows = tr; rows < min(tr + TILESIZE, nrows); rows++)
+        for (cols = tc; cols < min(tc + TILESIZE, ncols); cols++)
+          temp(cols, rows) = image[rows * stride + cols];
+
+  return temp;
+}
+
+/**
+ * Filters every row with a 1-D kernel (correlation, centred on the middle
+ * tap). Pixels outside the image are replaced by the nearest border pixel.
+ * @param kernel Filter taps.
+ * @param ksize Number of taps, should be odd.
+ * @return The filtered image.
+ */
+Image Image::filterRows(const float *kernel, int ksize) {
+  Image temp;
+  int rows, cols, k, c;
+  int half = ksize / 2;
+  float sum;
+
+  temp.createImage(nrows, ncols);
+
+  for (rows = 0; rows < nrows; rows++) {
+    float *in = &image[rows * stride];
+    for (cols = 0; cols < ncols; cols++) {
+      sum = 0;
+      if (cols >= half && cols + half < ncols)
+        for (k = 0; k < ksize; k++)
+          sum += kernel[k] * in[cols + k - half];
+      else
+        for (k = 0; k < ksize; k++) {
+          c = min(max(cols + k - half, 0), ncols - 1);
+          sum += kernel[k] * in[c];
+        }
+      temp(rows, cols) = sum;
+    }
+  }
+
+  return temp;
+}
+
+/**
+ * Filters every column with a 1-D kernel (correlation, centred on the middle
+ * tap). Pixels outside the image are replaced by the nearest border pixel.
+ * Instead of walking down whole columns the image is processed in vertical
+ * strips TILESIZE pixels wide; inside a strip the loops run along the rows,
+ * so the ksize input rows a strip needs stay in cache and the inner loop is
+ * contiguous.
+ * @param kernel Filter taps.
+ * @param ksize Number of taps, should be odd.
+ * @return The filtered image.
+ */
+Image Image::filterCols(const float *kernel, int ksize) {
+  Image temp;
+  int rows, cols, k, r, tc, width;
+  int half = ksize / 2;
+
+  temp.createImage(nrows, ncols);
+
+  for (tc = 0; tc < ncols; tc += TILESIZE) {
+    width = min(TILESIZE, ncols - tc);
+    for (rows = 0; rows < nrows; rows++) {
+      float *out = &temp(rows, tc);
+      for (k = 0; k < ksize; k++) {
+        r = min(max(rows + k - half, 0), nrows - 1);
+        const float *in = &image[r * stride + tc];
+        for (cols = 0; cols < width; cols++)
+          out[cols] += kernel[k] * in[cols];
+      }
+    }
+  }
+
+  return temp;
+}
+
+
+/**
+ * Union-find helpers for labelComponents(). Every tree is rooted at its
+ * smallest pixel index, so parent[i] <= i holds for every pixel. findRoot()
+ * halves the path it walks; rootOf() only reads, for the passes where
+ * other trees must not change under a concurrent reader.
+ */
+static int findRoot(int *parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static int rootOf(const int *parent, int i) {
+  while (parent[i] != i)
+    i = parent[i];
+  return i;
+}
+
+static void uniteRoots(int *parent, int a, int b) {
+  a = findRoot(parent, a);
+  b = findRoot(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+/**
+ * Adds the pixel at (rows, cols) with the given value to a region.
+ */
+static void addToRegion(Region &region, int rows, int cols, float value) {
+  region.area++;
+  region.top = min(region.top, rows);
+  region.bottom = max(region.bottom, rows);
+  region.left = min(region.left, cols);
+  region.right = max(region.right, cols);
+  region.centroidRow += rows;
+  region.centroidCol += cols;
+  region.sum += value;
+}
+
+static Region emptyRegion(int label) {
+  Region region;
+
+  region.label = label;
+  region.area = 0;
+  region.top = region.left = INT_MAX;
+  region.bottom = region.right = -1;
+  region.centroidRow = region.centroidCol = 0;
+  region.sum = 0;
+  return region;
+}
+
+/**
+ * Labels the connected components of the image. Every pixel that is not
+ * equal to background is foreground. The rows are split into one strip per
+ * thread and each strip is scanned with its own union-find forest. The
+ * strips are then joined along their border rows, which only re-parents
+ * roots; those few roots are pointed straight at their final root. After
+ * that every strip is finished in parallel: it flattens its own trees,
+ * gives its roots consecutive labels (in raster order, 1, 2, ...) and
+ * accumulates the area, bounding box, centroid and intensity sum of the
+ * components rooted in it directly into regions. Pixels whose component is
+ * rooted in an earlier strip are gathered per strip and merged at the end.
+ * @param regions Filled with one entry per component, regions[k] has label k + 1.
+ * @param connectivity 4 or 8.
+ * @param background Value of the background pixels.
+ * @return The label image, 0 on the background.
+ */
+Image Image::labelComponents(vector<Region> &regions, int connectivity, float background) {
+  Image temp;
+  int rows, cols, i, s;
+  int n = nrows * ncols;
+  int strips = min(numThreads(), nrows);
+  int stripHeight;
+  int *parent;
+
+  if (connectivity != 4 && connectivity != 8) {
+    cout << "labelComponents: Connectivity must be 4 or 8\n";
+    exit(3);
+  }
+  regions.clear();
+  if (n == 0)
+    return temp;
+  stripHeight = (nrows + strips - 1) / strips;
+
+  temp.createImage(nrows, ncols);
+  parent = new int [n];
+
+  // label every strip on its own
+#pragma omp parallel for private(rows, cols, i) schedule(static, 1)
+  for (s = 0; s < strips; s++) {
+    int first = s * stripHeight;
+    int last = min(first + stripHeight, nrows);
+    for (rows = first; rows < last; rows++)
+      for (cols = 0; cols < ncols; cols++) {
+        i = rows * ncols + cols;
+        if (image[rows * stride + cols] == background) {
+          parent[i] = -1;
+          continue;
+        }
+        parent[i] = i;
+        if (cols > 0 && parent[i - 1] >= 0)
+          uniteRoots(parent, i, i - 1);
+        if (rows > first) {
+          if (parent[i - ncols] >= 0)
+            uniteRoots(parent, i, i - ncols);
+          if (connectivity == 8) {
+            if (cols > 0 && parent[i - ncols - 1] >= 0)
+              uniteRoots(parent, i, i - ncols - 1);
+            if (cols < ncols - 1 && parent[i - ncols + 1] >= 0)
+              uniteRoots(parent, i, i - ncols + 1);
+          }
+        }
+      }
+  }
+
+  // merge the strips along their borders; only roots change here, and the
+  // ones that get a parent are remembered
+  vector<int> merged;
+  for (s = 1; s < strips; s++) {
+    rows = s * stripHeight;
+    if (rows >= nrows)
+      break;
+    for (cols = 0; cols < ncols; cols++) {
+      i = rows * ncols + cols;
+      if (parent[i] < 0)
+        continue;
+      for (int d = (connectivity == 8 ? -1 : 0); d <= (connectivity == 8 ? 1 : 0); d++) {
+        if (cols + d < 0 || cols + d >= ncols || parent[i - ncols + d] < 0)
+          continue;
+        int a = rootOf(parent, i), b = rootOf(parent, i - ncols + d);
+        if (a != b) {
+          parent[max(a, b)] = min(a, b);
+          merged.push_back(max(a, b));
+        }
+      }
+    }
+  }
+  for (i = 0; i < (int) merged.size(); i++)
+    parent[merged[i]] = rootOf(parent, merged[i]);
+
+  // flatten every strip and count its roots. Inside a strip parent[i] < i,
+  // so the parent is already final when i is reached; a parent outside the
+  // strip is a merged root, which is final already
+  vector<int> firstLabel(strips + 1, 0);
+#pragma omp parallel for private(i) schedule(static, 1)
+  for (s = 0; s < strips; s++) {
+    int first = min(s * stripHeight, nrows) * ncols;
+    int last = min((s + 1) * stripHeight, nrows) * ncols;
+    int roots = 0;
+    for (i = first; i < last; i++) {
+      int p = parent[i];
+      if (p < 0)
+        continue;
+      if (p == i)
+        roots++;
+      else if (p >= first)
+        parent[i] = parent[p];
+    }
+    firstLabel[s + 1] = roots;
+  }
+  for (s = 0; s < strips; s++)
+    firstLabel[s + 1] += firstLabel[s];
+  regions.resize(firstLabel[strips]);
+
+  // label the roots
+#pragma omp parallel for private(i) schedule(static, 1)
+  for (s = 0; s < strips; s++) {
+    int first = min(s * stripHeight, nrows) * ncols;
+    int last = min((s + 1) * stripHeight, nrows) * ncols;
+    int label = firstLabel[s];
+    for (i = first; i < last; i++)
+      if (parent[i] == i) {
+        temp.image[i] = ++label;
+        regions[label - 1] = emptyRegion(label);
+      }
+  }
+
+  // label the other pixels and gather the statistics
+  vector< map<int, Region> > foreign(strips);
+#pragma omp parallel for private(rows, cols, i) schedule(static, 1)
+  for (s = 0; s < strips; s++) {
+    int first = min(s * stripHeight, nrows);
+    int last = min((s + 1) * stripHeight, nrows);
+    for (rows = first; rows < last; rows++)
+      for (cols = 0; cols < ncols; cols++) {
+        i = rows * ncols + cols;
+        if (parent[i] < 0)
+          continue;
+        int label = (int) temp.image[parent[i]];
+        temp.image[i] = label;
+        if (parent[i] >= first * ncols)
+          addToRegion(regions[label - 1], rows, cols, image[rows * stride + cols]);
+        else {
+          map<int, Region>::iterator it = foreign[s].find(label);
+          if (it == foreign[s].end())
+            it = foreign[s].insert(make_pair(label, emptyRegion(label))).first;
+          addToRegion(it->second, rows, cols, image[rows * stride + cols]);
+        }
+      }
+  }
+
+  for (s = 0; s < strips; s++)
+    for (map<int, Region>::iterator it = foreign[s].begin(); it != foreign[s].end(); it++) {
+      Region &region = regions[it->first - 1], &part = it->second;
+      region.area += part.area;
+      region.top = min(region.top, part.top);
+      region.bottom = max(region.bottom, part.bottom);
+      region.left = min(region.left, part.left);
+      region.right = max(region.right, part.right);
+      region.centroidRow += part.centroidRow;
+      region.centroidCol += part.centroidCol;
+      region.sum += part.sum;
+    }
+
+#pragma omp parallel for
+  for (i = 0; i < (int) regions.size(); i++) {
+    regions[i].centroidRow /= regions[i].area;
+    regions[i].centroidCol /= regions[i].area;
+  }
+
+  delete [] parent;
+  return temp;
+}
+
+
+/**
+ * Cubic convolution kernel (Catmull-Rom, a = -0.5) used by the bicubic
+ * sampling: interpolates between the taps b and c, with a and d the taps
+ * before and after them, at the fraction t past b.
+ */
+static inline float cubicMix(float t, float a, float b, float c, float d) {
+  float t2 = t * t, t3 = t2 * t;
+
+  return (-0.5f * t3 + t2 - 0.5f * t) * a + (1.5f * t3 - 2.5f * t2 + 1.0f) * b +
+         (-1.5f * t3 + 2.0f * t2 + 0.5f * t) * c + (0.5f * t3 - 0.5f * t2) * d;
+}
+
+/**
+ * Tells whether every tap the interpolation reads for the position (y, x)
+ * lies inside the image, so that the fill and border handling can be
+ * skipped. Written as comparisons on the position itself, which are
+ * equivalent to testing the rounded taps.
+ */
+static bool insideTaps(double y, double x, int nrows, int ncols, int interpolation) {
+  if (interpolation == NEAREST)
+    return x + 0.5 >= 0 && y + 0.5 >= 0 && x + 0.5 < ncols && y + 0.5 < nrows;
+  if (interpolation == BILINEAR)
+    return x >= 0 && y >= 0 && x < ncols - 1 && y < nrows - 1;
+  return x >= 1 && y >= 1 && x < ncols - 2 && y < nrows - 2;
+}
+
+/**
+ * Samples n positions all of whose taps are inside the image (see
+ * insideTaps()). The interpolation switch is outside the loops and there
+ * is no test in them, so they vectorize (with gathers where the target has
+ * them). The positions are not negative here, so a cast rounds them down
+ * like floor().
+ */
+static void sampleSpan(const float *img, int stride, const double *ys, const double *xs,
+                       int n, int interpolation, float *out) {
+  int k;
+
+  switch (interpolation) {
+  case NEAREST:
+#pragma omp simd
+    for (k = 0; k < n; k++)
+      out[k] = img[(int) (ys[k] + 0.5) * stride + (int) (xs[k] + 0.5)];
+    break;
+
+  case BILINEAR:
+#pragma omp simd
+    for (k = 0; k < n; k++) {
+      int x0 = (int) xs[k], y0 = (int) ys[k];
+      int p = y0 * stride + x0;
+      float fx = xs[k] - x0, fy = ys[k] - y0;
+      out[k] = (1 - fy) * ((1 - fx) * img[p] + fx * img[p + 1]) +
+               fy * ((1 - fx) * img[p + stride] + fx * img[p + stride + 1]);
+    }
+    break;
+
+  default:
+#pragma omp simd
+    for (k = 0; k < n; k++) {
+      int x0 = (int) xs[k], y0 = (int) ys[k];
+      int p = (y0 - 1) * stride + x0 - 1, q = p + stride, r = q + stride, s = r + stride;
+      float fx = xs[k] - x0, fy = ys[k] - y0;
+      out[k] = cubicMix(fy, cubicMix(fx, img[p], img[p + 1], img[p + 2], img[p + 3]),
+                        cubicMix(fx, img[q], img[q + 1], img[q + 2], img[q + 3]),
+                        cubicMix(fx, img[r], img[r + 1], img[r + 2], img[r + 3]),
+                        cubicMix(fx, img[s], img[s + 1], img[s + 2], img[s + 3]));
+    }
+    break;
+  }
+}
+
+/**
+ * Samples img at the real position (y, x). Taps that fall outside the image
+ * count as fill, and so does a position with no tap inside the image.
+ * Positions with every tap inside go through sampleSpan(), so a pixel
+ * gets the same value whichever way it is sampled.
+ */
+static float samplePix(const float *img, int nrows, int ncols, int stride,
+                       double y, double x, int interpolation, float fill) {
+  int x0, y0, i, j, r, c;
+  float fx, fy, v[4], row[4];
+
+  if (x <= -1 || y <= -1 || x >= ncols || y >= nrows)
+    return fill;
+
+  if (insideTaps(y, x, nrows, ncols, interpolation)) {
+    sampleSpan(img, stride, &y, &x, 1, interpolation, v);
+    return v[0];
+  }
+  if (interpolation == NEAREST)
+    return fill;
+
+  x0 = (int) floor(x);
+  y0 = (int) floor(y);
+  fx = x - x0;
+  fy = y - y0;
+
+  if (interpolation == BILINEAR) {
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < 2; j++) {
+        r = y0 + i;
+        c = x0 + j;
+        v[j] = (r < 0 || c < 0 || r >= nrows || c >= ncols) ? fill : img[r * stride + c];
+      }
+      row[i] = (1 - fx) * v[0] + fx * v[1];
+    }
+    return (1 - fy) * row[0] + fy * row[1];
+  }
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) {
+      r = y0 - 1 + i;
+      c = x0 - 1 + j;
+      v[j] = (r < 0 || c < 0 || r >= nrows || c >= ncols) ? fill : img[r * stride + c];
+    }
+    row[i] = cubicMix(fx, v[0], v[1], v[2], v[3]);
+  }
+  return cubicMix(fy, row[0], row[1], row[2], row[3]);
+}
+
+/**
+ * Affine warp. The matrix maps every output pixel (row y, column x) back to
+ * the source position
+ *     xs = m[0] * x + m[1] * y + m[2]
+ *     ys = m[3] * x + m[4] * y + m[5]
+ * which is then sampled. Along a row the source position only grows by
+ * (m[0], m[3]), so it is updated with two additions per pixel instead of a
+ * matrix product. The output is cut into TILESIZE x TILESIZE tiles which
+ * are spread over the threads.
+ * @param matrix The 2x3 output-to-source matrix, row-major.
+ * @param outRows Output height, 0 for the input height.
+ * @param outCols Output width, 0 for the input width.
+ * @param interpolation NEAREST, BILINEAR or BICUBIC.
+ * @param fill Value of the pixels that map outside the image.
+ * @return The warped image.
+ */
+Image Image::warpAffine(const float *matrix, int outRows, int outCols,
+                        int interpolation, float fill) {
+  float perspective[9];
+
+  perspective[0] = matrix[0]; perspective[1] = matrix[1]; perspective[2] = matrix[2];
+  perspective[3] = matrix[3]; perspective[4] = matrix[4]; perspective[5] = matrix[5];
+  perspective[6] = 0; perspective[7] = 0; perspective[8] = 1;
+
+  return warpPerspective(perspective, outRows, outCols, interpolation, fill);
+}
+
+/**
+ * Perspective warp. The matrix maps every output pixel (row y, column x)
+ * back to the source position
+ *     xs = (h[0] * x + h[1] * y + h[2]) / (h[6] * x + h[7] * y + h[8])
+ *     ys = (h[3] * x + h[4] * y + h[5]) / (h[6] * x + h[7] * y + h[8])
+ * The three sums are stepped incrementally along each row; when the last
+ * row of the matrix is (0, 0, 1) the division is skipped, so an affine warp
+ * costs two additions per pixel for the coordinates. The output is cut into
+ * TILESIZE x TILESIZE tiles which are spread over the threads.
+ *
+ * The source positions of a tile row are computed first. Where a row
+ * crosses the image, the positions whose taps are all inside form one
+ * span; it is sampled by sampleSpan() without any test per pixel, and only
+ * the pixels before and after it go through the border and fill handling
+ * of samplePix(). A row whose inside positions are not contiguous (a
+ * perspective row through the horizon) is sampled pixel by pixel.
+ * @param matrix The 3x3 output-to-source matrix, row-major.
+ * @param outRows Output height, 0 for the input height.
+ * @param outCols Output width, 0 for the input width.
+ * @param interpolation NEAREST, BILINEAR or BICUBIC.
+ * @param fill Value of the pixels that map outside the image.
+ * @return The warped image.
+ */
+Image Image::warpPerspective(const float *matrix, int outRows, int outCols,
+                             int interpolation, float fill) {
+  Image temp;
+  int t, tilesDown, tilesAcross;
+  bool affine = matrix[6] == 0 && matrix[7] == 0 && matrix[8] == 1;
+
+  if (outRows <= 0)
+    outRows = nrows;
+  if (outCols <= 0)
+    outCols = ncols;
+  if (interpolation != NEAREST && interpolation != BILINEAR && interpolation != BICUBIC) {
+    cout << "warpPerspective: Unknown interpolation\n";
+    exit(3);
+  }
+
+  temp.createImage(outRows, outCols);
+  tilesDown = (outRows + TILESIZE - 1) / TILESIZE;
+  tilesAcross = (outCols + TILESIZE - 1) / TILESIZE;
+
+#pragma omp parallel for schedule(dynamic)
+  for (t = 0; t < tilesDown * tilesAcross; t++) {
+    int r0 = (t / tilesAcross) * TILESIZE;
+    int c0 = (t % tilesAcross) * TILESIZE;
+    int r1 = min(r0 + TILESIZE, outRows);
+    int c1 = min(c0 + TILESIZE, outCols);
+    int n = c1 - c0;
+    int rows, k, lo, hi;
+    double xv[TILESIZE], yv[TILESIZE];
+    bool inside;
+
+    for (rows = r0; rows < r1; rows++) {
+      double xs = matrix[0] * c0 + matrix[1] * rows + matrix[2];
+      double ys = matrix[3] * c0 + matrix[4] * rows + matrix[5];
+      double ws = matrix[6] * c0 + matrix[7] * rows + matrix[8];
+      float *out = &temp.image[rows * outCols + c0];
+
+      for (k = 0; k < n; k++) {
+        if (affine) {
+          xv[k] = xs;
+          yv[k] = ys;
+        }
+        else if (ws != 0) {
+          xv[k] = xs / ws;
+          yv[k] = ys / ws;
+        }
+        else
+          xv[k] = yv[k] = -2;    // on the horizon: samplePix() gives fill
+        xs += matrix[0];
+        ys += matrix[3];
+        ws += matrix[6];
+      }
+
+      // the span of positions with every tap inside
+      for (lo = 0; lo < n && !insideTaps(yv[lo], xv[lo], nrows, ncols, interpolation); lo++)
+        ;
+      for (hi = n; hi > lo && !insideTaps(yv[hi - 1], xv[hi - 1], nrows, ncols, interpolation); hi--)
+        ;
+      inside = true;
+      for (k = lo; k < hi; k++)
+        inside &= insideTaps(yv[k], xv[k], nrows, ncols, interpolation);
+      if (!inside)
+        lo = hi = n;
+
+      sampleSpan(image, stride, &yv[lo], &xv[lo], hi - lo, interpolation, &out[lo]);
+      for (k = 0; k < lo; k++)
+        out[k] = samplePix(image, nrows, ncols, stride, yv[k], xv[k], interpolation, fill);
+      for (k = hi; k < n; k++)
+        out[k] = samplePix(image, nrows, ncols, stride, yv[k], xv[k], interpolation, fill);
+    }
+  }
+
+  return temp;
+}
+
+/**
+ * Rotates the image about its centre. The output has the size of the input,
+ * corners that come from outside the image get the fill value.
+ * @param angle Rotation angle in degrees, counter-clockwise on screen.
+ * @param interpolation NEAREST, BILINEAR or BICUBIC.
+ * @param fill Value of the pixels that map outside the image.
+ * @return The rotated image.
+ */
+Image Image::rotate(float angle, int interpolation, float fill) {
+  float matrix[6];
+  double a = angle * M_PI / 180.0;
+  double cy = (nrows - 1) / 2.0, cx = (ncols - 1) / 2.0;
+
+  // source = centre + R(angle) * (output - centre), rows pointing down
+  matrix[0] = cos(a);
+  matrix[1] = -sin(a);
+  matrix[2] = cx - cos(a) * cx + sin(a) * cy;
+  matrix[3] = sin(a);
+  matrix[4] = cos(a);
+  matrix[5] = cy - sin(a) * cx - cos(a) * cy;
+
+  return warpAffine(matrix, nrows, ncols, interpolation, fill);
+}
+
+
+/**
+ * Sobel gradient of one row, borders clamped. Writes the L2 magnitude and
+ * the gradient direction quantized to 0 (horizontal), 1 (down-right
+ * diagonal), 2 (vertical) or 3 (down-left diagonal). The nine neighbours of
+ * a pixel are read once for both derivatives.
+ */
+static void sobelRow(const float *img, int nrows, int ncols, int stride, int row,
+                     float *mag, float *dir) {
+  const float *up = &img[max(row - 1, 0) * stride];
+  const float *mid = &img[row * stride];
+  const float *down = &img[min(row + 1, nrows - 1) * stride];
+  int cols, l, r;
+  float gx, gy, ax, ay;
+
+  for (cols = 0; cols < ncols; cols++) {
+    l = max(cols - 1, 0);
+    r = min(cols + 1, ncols - 1);
+    gx = (up[r] + 2 * mid[r] + down[r]) - (up[l] + 2 * mid[l] + down[l]);
+    gy = (down[l] + 2 * down[cols] + down[r]) - (up[l] + 2 * up[cols] + up[r]);
+    mag[cols] = sqrt(gx * gx + gy * gy);
+
+    ax = fabs(gx);
+    ay = fabs(gy);
+    if (ay <= 0.41421356f * ax)          // tan(22.5)
+      dir[cols] = 0;
+    else if (ay >= 2.41421356f * ax)     // tan(67.5)
+      dir[cols] = 2;
+    else
+      dir[cols] = (gx > 0) == (gy > 0) ? 1 : 3;
+  }
+}
+
+/**
+ * Sobel edge detector. The gradient magnitude and its quantized direction
+ * come out of one pass over the image, so no gradient images are built.
+ * @param direction Receives the direction of every pixel: 0 horizontal,
+ *        1 down-right diagonal, 2 vertical, 3 down-left diagonal.
+ * @return The gradient magnitude.
+ */
+Image Image::sobel(Image &direction) {
+  Image temp;
+  int rows;
+
+  temp.createImage(nrows, ncols);
+  direction.createImage(nrows, ncols);
+
+#pragma omp parallel for
+  for (rows = 0; rows < nrows; rows++)
+    sobelRow(image, nrows, ncols, stride, rows, &temp(rows, 0), &direction(rows, 0));
+
+  return temp;
+}
+
+/**
+ * Canny edge detector on the Sobel gradient.
+ *
+ * The rows are split into one strip per thread. Each strip keeps the
+ * gradient of three rows in a rolling buffer and does non-maximum
+ * suppression on the middle one, writing 255 for strong and 128 for weak
+ * edge pixels straight into the output. Hysteresis then grows the strong
+ * pixels into the weak ones they touch (8-connected) and clears the rest,
+ * so the output is the only full-size buffer.
+ * @param lowThreshold Weak edge threshold on the gradient magnitude.
+ * @param highThreshold Strong edge threshold on the gradient magnitude.
+ * @return The edge map, 255 on the edges and 0 elsewhere.
+ */
+Image Image::canny(float lowThreshold, float highThreshold) {
+  Image temp;
+  int s, i;
+  int strips = min(numThreads(), nrows);
+  int stripHeight;
+
+  if (nrows == 0 || ncols == 0)
+    return temp;
+  stripHeight = (nrows + strips - 1) / strips;
+  vector< vector<int> > seeds(strips);
+
+  temp.createImage(nrows, ncols);
+
+#pragma omp parallel for schedule(static, 1)
+  for (s = 0; s < strips; s++) {
+    int first = s * stripHeight;
+    int last = min(first + stripHeight, nrows);
+    vector<float> magBuf(3 * ncols), dirBuf(3 * ncols);
+    float *mag[3], *dir[3];
+    int rows, cols, k, l, r;
+    float m, n1, n2;
+
+    for (k = 0; k < 3; k++) {
+      mag[k] = &magBuf[k * ncols];
+      dir[k] = &dirBuf[k * ncols];
+    }
+    if (first < last) {
+      sobelRow(image, nrows, ncols, stride, max(first - 1, 0), mag[0], dir[0]);
+      sobelRow(image, nrows, ncols, stride, first, mag[1], dir[1]);
+    }
+
+    for (rows = first; rows < last; rows++) {
+      sobelRow(image, nrows, ncols, stride, min(rows + 1, nrows - 1), mag[2], dir[2]);
+
+      for (cols = 0; cols < ncols; cols++) {
+        m = mag[1][cols];
+        if (m < lowThreshold)
+          continue;
+        l = max(cols - 1, 0);
+        r = min(cols + 1, ncols - 1);
+        switch ((int) dir[1][cols]) {
+        case 0: n1 = mag[1][l]; n2 = mag[1][r]; break;
+        case 1: n1 = mag[0][l]; n2 = mag[2][r]; break;
+        case 2: n1 = mag[0][cols]; n2 = mag[2][cols]; break;
+        default: n1 = mag[0][r]; n2 = mag[2][l]; break;
+        }
+        if (m > n1 && m >= n2) {
+          if (m >= highThreshold) {
+            temp.image[rows * ncols + cols] = 255;
+            seeds[s].push_back(rows * ncols + cols);
+          }
+          else
+            temp.image[rows * ncols + cols] = 128;
+        }
+      }
+
+      // roll the buffers up by one row
+      float *t = mag[0]; mag[0] = mag[1]; mag[1] = mag[2]; mag[2] = t;
+      t = dir[0]; dir[0] = dir[1]; dir[1] = dir[2]; dir[2] = t;
+    }
+  }
+
+  // hysteresis: weak pixels connected to a strong one become strong
+  vector<int> stack;
+  for (s = 0; s < strips; s++)
+    stack.insert(stack.end(), seeds[s].begin(), seeds[s].end());
+
+  while (!stack.empty()) {
+    i = stack.back();
+    stack.pop_back();
+    int rows = i / ncols, cols = i % ncols;
+    for (int dr = -1; dr <= 1; dr++)
+      for (int dc = -1; dc <= 1; dc++) {
+        int rr = rows + dr, cc = cols + dc;
+        if (rr < 0 || cc < 0 || rr >= nrows || cc >= ncols)
+          continue;
+        if (temp.image[rr * ncols + cc] == 128) {
+          temp.image[rr * ncols + cc] = 255;
+          stack.push_back(rr * ncols + cc);
+        }
+      }
+  }
+
+#pragma omp parallel for
+  for (i = 0; i < nrows * ncols; i++)
+    if (temp.image[i] == 128)
+      temp.image[i] = 0;
+
+  return temp;
+}
+
+
+/**
+ * Coefficients of the Young - van Vliet recursive Gaussian,
+ *     w[n] = B x[n] + a1 w[n-1] + a2 w[n-2] + a3 w[n-3]
+ * run forwards and the same filter run backwards over w. The poles and the
+ * mapping from sigma to the pole scale q are those of Young, van Vliet and
+ * van Ginkel (2002), which make the variance of the forward-backward pair
+ * exactly sigma^2; the 1995 mapping made it about 10% wider. Against a
+ * sampled Gaussian of the same sigma the impulse response is off by about
+ * 7% in L2 norm (slightly too peaked, with heavier tails) and a step edge
+ * by at most 2% of the step height, for sigma from 3 to 40.
+ * @param sigma Standard deviation, at least 0.5.
+ * @param c Receives B, a1, a2, a3.
+ */
+static void youngCoefficients(float sigma, double *c) {
+  const double m0 = 1.16680, m1 = 1.10783, m2 = 1.40586;
+  double q, scale;
+
+  q = 1.31564 * (sqrt(1 + 0.490811 * sigma * sigma) - 1);
+  scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2 * m1 * q + q * q);
+
+  c[1] = q * (2 * m0 * m1 + m1 * m1 + m2 * m2 + (2 * m0 + 4 * m1) * q + 3 * q * q) / scale;
+  c[2] = -q * q * (m0 + 2 * m1 + 3 * q) / scale;
+  c[3] = q * q * q / scale;
+  c[0] = 1 - (c[1] + c[2] + c[3]);
+}
+
+/**
+ * Boundary matrix for the end of a line (as in Triggs and Sdika). Past the
+ * last sample the line is taken to continue with that sample's value.
+ * The backward pass then has to start from the values it would have after
+ * running over that infinite tail. Those values minus the edge value depend
+ * linearly on the last three forward outputs minus the edge value:
+ *     y[n + k] - x = sum_j M[k][j] (w[n - 1 - j] - x)
+ * M is found once per sigma by running the three unit responses through a
+ * tail long enough for the filter to die out.
+ */
+static void boundaryMatrix(const double *c, float sigma, double M[3][3]) {
+  int tail = (int) (12 * sigma) + 32;
+  vector<double> w(tail + 3), y(tail + 3);
+  int j, n;
+
+  for (j = 0; j < 3; j++) {
+    // w[0..2] hold w[n-3], w[n-2], w[n-1]
+    fill(w.begin(), w.end(), 0.0);
+    w[2 - j] = 1;
+    for (n = 3; n < tail + 3; n++)
+      w[n] = c[1] * w[n - 1] + c[2] * w[n - 2] + c[3] * w[n - 3];
+
+    fill(y.begin(), y.end(), 0.0);
+    for (n = tail + 2; n >= 3; n--)
+      y[n] = c[0] * w[n] + c[1] * (n + 1 < tail + 3 ? y[n + 1] : 0)
+             + c[2] * (n + 2 < tail + 3 ? y[n + 2] : 0)
+             + c[3] * (n + 3 < tail + 3 ? y[n + 3] : 0);
+
+    M[0][j] = y[3];
+    M[1][j] = y[4];
+    M[2][j] = y[5];
+  }
+}
+
+/**
+ * Runs the forward and backward recursive passes down every column of a
+ * rows x cols buffer, in place. The columns are handled TILESIZE at a time
+ * and the recursion steps along whole rows of the strip, so the inner loop
+ * is contiguous and vectorizes. The strips are spread over the threads.
+ */
+static void recursiveCols(float *data, int nrows, int ncols, const double *c,
+                          double M[3][3]) {
+  int tc;
+
+#pragma omp parallel for schedule(dynamic)
+  for (tc = 0; tc < ncols; tc += TILESIZE) {
+    int width = min(TILESIZE, ncols - tc);
+    int rows, cols, j, k;
+    double B = c[0], a1 = c[1], a2 = c[2], a3 = c[3];   // float coefficients drift for wide sigmas
+    vector<float> pad(3 * width), edge(width);
+    float *p1, *p2, *p3, *out;
+
+    // forward pass, the column starts as if its first pixel went on forever
+    for (cols = 0; cols < width; cols++) {
+      pad[cols] = pad[width + cols] = pad[2 * width + cols] = data[tc + cols];
+      edge[cols] = data[(nrows - 1) * ncols + tc + cols];
+    }
+    for (rows = 0; rows < nrows; rows++) {
+      out = &data[rows * ncols + tc];
+      p1 = rows > 0 ? out - ncols : &pad[0];
+      p2 = rows > 1 ? out - 2 * ncols : &pad[width];
+      p3 = rows > 2 ? out - 3 * ncols : &pad[2 * width];
+      for (cols = 0; cols < width; cols++)
+        out[cols] = B * out[cols] + a1 * p1[cols] + a2 * p2[cols] + a3 * p3[cols];
+    }
+
+    // backward pass, started from where it would be after the constant
+    // continuation of the column past its last pixel
+    for (j = 0; j < 3; j++)
+      for (cols = 0; cols < width; cols++) {
+        double sum = edge[cols];
+        for (k = 0; k < 3; k++)
+          sum += M[j][k] * (data[max(nrows - 1 - k, 0) * ncols + tc + cols] - edge[cols]);
+        pad[j * width + cols] = sum;
+      }
+    for (rows = nrows - 1; rows >= 0; rows--) {
+      out = &data[rows * ncols + tc];
+      p1 = rows < nrows - 1 ? out + ncols : &pad[0];
+      p2 = rows < nrows - 2 ? out + 2 * ncols : &pad[(rows + 2 - nrows) * width];
+      p3 = rows < nrows - 3 ? out + 3 * ncols : &pad[(rows + 3 - nrows) * width];
+      for (cols = 0; cols < width; cols++)
+        out[cols] = B * out[cols] + a1 * p1[cols] + a2 * p2[cols] + a3 * p3[cols];
+    }
+  }
+}
+
+/**
+ * Gaussian blur with the recursive filter of Young and van Vliet. Every
+ * pixel costs the same handful of multiply-adds whatever sigma is, so wide
+ * blurs are as cheap as narrow ones. Each direction gets a forward and a
+ * backward pass; the vertical passes run straight down the columns and the
+ * horizontal ones run on the (blocked) transpose, so both walk the memory
+ * row by row. Borders behave as if the edge pixels went on forever.
+ * @param sigma Standard deviation in pixels, at least 0.5.
+ * @return The blurred image.
+ */
+Image Image::gaussianBlur(float sigma) {
+  Image temp, flipped;
+  double c[4], M[3][3];
+
+  if (sigma < 0.5) {
+    cout << "gaussianBlur: sigma must be at least 0.5\n";
+    exit(3);
+  }
+  youngCoefficients(sigma, c);
+  boundaryMatrix(c, sigma, M);
+
+  temp = *this;
+  recursiveCols(temp.image, nrows, ncols, c, M);
+  flipped = temp.transpose();
+  recursiveCols(flipped.image, ncols, nrows, c, M);
+
+  return flipped.transpose();
+}
+
+
+/**
+ * Blurs one axis of the bilateral grid (value-weight pairs) with the
+ * tabulated kernel. The grid is n0 x n1 x n2 cells; stride is the distance
+ * between neighbours along the blurred axis, count the number of cells
+ * along it and the lines are enumerated by (outer, inner).
+ */
+static void blurGridAxis(float *grid, int lines, int inner, int count, int stride,
+                         int outerStride, const vector<float> &kernel) {
+  int radius = kernel.size() / 2;
+  int l;
+
+#pragma omp parallel for
+  for (l = 0; l < lines; l++) {
+    float *base = grid + 2 * ((size_t) (l / inner) * outerStride + (l % inner));
+    vector<float> line(2 * count);
+    int i, k, j;
+
+    for (i = 0; i < count; i++) {
+      line[2 * i] = base[2 * (size_t) i * stride];
+      line[2 * i + 1] = base[2 * (size_t) i * stride + 1];
+    }
+    for (i = 0; i < count; i++) {
+      float v = 0, w = 0;
+      for (k = -radius; k <= radius; k++) {
+        j = i + k;
+        if (j < 0 || j >= count)
+          continue;
+        v += kernel[k + radius] * line[2 * j];
+        w += kernel[k + radius] * line[2 * j + 1];
+      }
+      base[2 * (size_t) i * stride] = v;
+      base[2 * (size_t) i * stride + 1] = w;
+    }
+  }
+}
+
+/**
+ * Approximate bilateral filter on a bilateral grid (Paris and Durand).
+ * Every pixel is splatted into a coarse 3D grid of (row, column,
+ * intensity) cells, sigmaSpatial * sampling pixels by sigmaRange * sampling
+ * grey levels each, as a value-weight pair. The grid is blurred along its
+ * three axes with a Gaussian whose taps come from a table computed once,
+ * and the result is sliced back out by trilinear interpolation at each
+ * pixel. The cost does not depend on the spatial radius and no exp() is
+ * evaluated per pixel.
+ * @param sigmaSpatial Spatial standard deviation in pixels.
+ * @param sigmaRange Range standard deviation in grey levels.
+ * @param sampling Cell size in units of sigma. Smaller values give a finer,
+ *        more accurate and more expensive grid; 1 is the usual trade-off.
+ * @return The filtered image.
+ */
+Image Image::bilateralFilter(float sigmaSpatial, float sigmaRange, float sampling) {
+  Image temp;
+  int rows, cols, k;
+
+  if (sigmaSpatial <= 0 || sigmaRange <= 0 || sampling <= 0) {
+    cout << "bilateralFilter: sigmas and sampling must be positive\n";
+    exit(3);
+  }
+  if (nrows == 0 || ncols == 0)
+    return temp;
+
+  float mini = getMinimum(), maxi = getMaximum();
+  float cellSpace = sigmaSpatial * sampling;
+  float cellRange = sigmaRange * sampling;
+  float sigmaCells = 1.0 / sampling;          // blur width measured in cells
+  int radius = (int) ceil(2 * sigmaCells);
+  int pad = radius;
+  int gh = (int) ((nrows - 1) / cellSpace) + 2 + 2 * pad;
+  int gw = (int) ((ncols - 1) / cellSpace) + 2 + 2 * pad;
+  int gd = (int) ((maxi - mini) / cellRange) + 2 + 2 * pad;
+  vector<float> grid((size_t) gh * gw * gd * 2, 0.0f);
+  vector<float> kernel(2 * radius + 1);
+
+  for (k = -radius; k <= radius; k++)
+    kernel[k + radius] = exp(-0.5 * k * k / (sigmaCells * sigmaCells));
+
+  // splat, every pixel goes to its nearest cell. The image rows that round
+  // to grid row g are first[g] up to first[g + 1], and each grid row is
+  // splatted by one thread, so no cell is written by two threads and the
+  // sums come out in the same order as a serial splat.
+  vector<int> first(gh + 1, nrows);
+
+  for (rows = nrows - 1; rows >= 0; rows--)
+    first[(int) (rows / cellSpace + 0.5) + pad] = rows;
+  for (k = gh - 1; k >= 0; k--)
+    first[k] = min(first[k], first[k + 1]);
+
+#pragma omp parallel for private(rows, cols) schedule(dynamic)
+  for (k = 0; k < gh; k++)
+    for (rows = first[k]; rows < first[k + 1]; rows++)
+      for (cols = 0; cols < ncols; cols++) {
+        float v = image[rows * stride + cols];
+        int gc = (int) (cols / cellSpace + 0.5) + pad;
+        int gz = (int) ((v - mini) / cellRange + 0.5) + pad;
+        float *cell = &grid[2 * (((size_t) k * gw + gc) * gd + gz)];
+        cell[0] += v;
+        cell[1] += 1;
+      }
+
+  // blur along intensity, columns and rows
+  blurGridAxis(&grid[0], gh * gw, 1, gd, 1, gd, kernel);
+  blurGridAxis(&grid[0], gh * gd, gd, gw, gd, gw * gd, kernel);
+  blurGridAxis(&grid[0], gw * gd, gw * gd, gh, gw * gd, 0, kernel);
+
+  // slice with trilinear interpolation
+  temp.createImage(nrows, ncols);
+
+#pragma omp parallel for private(cols)
+  for (rows = 0; rows < nrows; rows++)
+    for (cols = 0; cols < ncols; cols++) {
+      float v = image[rows * stride + cols];
+      float fr = rows / cellSpace + pad, fc = cols / cellSpace + pad;
+      float fz = (v - mini) / cellRange + pad;
+      int r0 = (int) fr, c0 = (int) fc, z0 = (int) fz;
+      float dr = fr - r0, dc = fc - c0, dz = fz - z0;
+      float value = 0, weight = 0;
+
+      for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+          for (int l = 0; l < 2; l++) {
+            float w = (i ? dr : 1 - dr) * (j ? dc : 1 - dc) * (l ? dz : 1 - dz);
+            const float *cell = &grid[2 * (((size_t) (r0 + i) * gw + c0 + j) * gd + z0 + l)];
+            value += w * cell[0];
+            weight += w * cell[1];
+          }
+      temp(rows, cols) = weight > 0 ? value / weight : v;
+    }
+
+  return temp;
+}
+
+/**
+ * Lower envelope of the parabolas (q - p)^2 + f[p] over one line of n
+ * samples (Felzenszwalb and Huttenlocher). Samples with an infinite f add
+ * no parabola.
+ * @param f Squared distances along the other axes, per sample.
+ * @param d Filled with the squared distance of each sample, infinite when
+ *        the line holds no finite f.
+ * @param arg Filled with the sample the distance is measured to, -1 if none.
+ * @param v, z Scratch space of n and n + 1 entries.
+ */
+static void lowerEnvelope(const double *f, int n, double *d, int *arg,
+                          int *v, double *z) {
+  int q, k = -1, j;
+
+  for (q = 0; q < n; q++) {
+    if (isinf(f[q]))
+      continue;
+    if (k < 0) {
+      k = 0;
+      v[0] = q;
+      z[0] = -HUGE_VAL;
+      z[1] = HUGE_VAL;
+      continue;
+    }
+    double s = ((f[q] + (double) q * q) - (f[v[k]] + (double) v[k] * v[k])) / (2.0 * (q - v[k]));
+    while (s <= z[k]) {
+      k--;
+      s = ((f[q] + (double) q * q) - (f[v[k]] + (double) v[k] * v[k])) / (2.0 * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = HUGE_VAL;
+  }
+
+  for (q = 0, j = 0; q < n; q++) {
+    if (k < 0) {
+      d[q] = HUGE_VAL;
+      arg[q] = -1;
+      continue;
+    }
+    while (z[j + 1] < q)
+      j++;
+    d[q] = (double) (q - v[j]) * (q - v[j]) + f[v[j]];
+    arg[q] = v[j];
+  }
+}
+
+/**
+ * Exact Euclidean distance transform shared by both distanceTransform()
+ * calls. The row pass finds the nearest feature of each row with a forward
+ * and a backward sweep; the column pass takes the lower envelope of the
+ * squared row distances, gathering TILESIZE columns at a time into
+ * contiguous lines. Both passes are linear in the pixel count and run in
+ * parallel over rows and over column strips.
+ */
+static Image distanceMap(const Image &img, float featureValue,
+                         Image *nearestRow, Image *nearestCol) {
+  Image temp;
+  int nrows = img.getRow(), ncols = img.getCol();
+  int rows, c0;
+
+  temp.createImage(nrows, ncols);
+  if (nearestRow != NULL) {
+    nearestRow->createImage(nrows, ncols);
+    nearestCol->createImage(nrows, ncols);
+  }
+
+  // row pass: distance to the nearest feature on the same row
+#pragma omp parallel for
+  for (rows = 0; rows < nrows; rows++) {
+    float *g = &temp(rows, 0);
+    float *at = nearestCol ? &(*nearestCol)(rows, 0) : NULL;
+    int cols, last = -1;
+
+    for (cols = 0; cols < ncols; cols++) {
+      if (img(rows, cols) == featureValue)
+        last = cols;
+      g[cols] = last >= 0 ? cols - last : INFINITY;
+      if (at)
+        at[cols] = last;
+    }
+    for (cols = ncols - 1, last = -1; cols >= 0; cols--) {
+      if (img(rows, cols) == featureValue)
+        last = cols;
+      if (last >= 0 && last - cols < g[cols]) {
+        g[cols] = last - cols;
+        if (at)
+          at[cols] = last;
+      }
+    }
+  }
+
+  // column pass: lower envelope of g^2 down each column
+#pragma omp parallel for schedule(dynamic)
+  for (c0 = 0; c0 < ncols; c0 += TILESIZE) {
+    int width = min(TILESIZE, ncols - c0);
+    vector<double> f((size_t) width * nrows), d(nrows), z(nrows + 1);
+    vector<float> at(nearestCol ? (size_t) width * nrows : 0);
+    vector<int> v(nrows), arg(nrows);
+    int r, c;
+
+    for (r = 0; r < nrows; r++)
+      for (c = 0; c < width; c++) {
+        double g = temp(r, c0 + c);
+        f[(size_t) c * nrows + r] = g * g;
+        if (nearestCol)
+          at[(size_t) c * nrows + r] = (*nearestCol)(r, c0 + c);
+      }
+
+    for (c = 0; c < width; c++) {
+      lowerEnvelope(&f[(size_t) c * nrows], nrows, &d[0], &arg[0], &v[0], &z[0]);
+      for (r = 0; r < nrows; r++) {
+        temp(r, c0 + c) = sqrt(d[r]);
+        if (nearestRow) {
+          (*nearestRow)(r, c0 + c) = arg[r];
+          (*nearestCol)(r, c0 + c) = arg[r] >= 0 ? at[(size_t) c * nrows + arg[r]] : -1;
+        }
+      }
+    }
+  }
+
+  return temp;
+}
+
+/**
+ * Euclidean distance transform. Every pixel gets its distance to the
+ * nearest feature pixel, a pixel whose value is featureValue (0 on a mask
+ * made by thresholdImage() measures the distance to the background). The
+ * result is exact and the cost grows linearly with the number of pixels.
+ * @param featureValue Value of the feature pixels.
+ * @return The distance map, 0 on the features and infinite everywhere when
+ *         there is no feature.
+ */
+Image Image::distanceTransform(float featureValue) {
+  return distanceMap(*this, featureValue, NULL, NULL);
+}
+
+/**
+ * Euclidean distance transform that also tells where the nearest feature
+ * pixel is.
+ * @param nearestRow Filled with the row of the nearest feature, -1 if none.
+ * @param nearestCol Filled with the column of the nearest feature, -1 if none.
+ * @param featureValue Value of the feature pixels.
+ * @return The distance map, as distanceTransform(featureValue).
+ */
+Image Image::distanceTransform(Image &nearestRow, Image &nearestCol, float featureValue) {
+  if (&nearestRow == this || &nearestCol == this || &nearestRow == &nearestCol) {
+    cout << "distanceTransform: Output images must be distinct\n";
+    exit(3);
+  }
+  return distanceMap(*this, featureValue, &nearestRow, &nearestCol);
+}
+
+/**
+ * Scale of the AAN 8-point DCT outputs: output k is sqrt(8) * aanScale[k]
+ * times the orthonormal coefficient (Arai, Agui and Nakajima).
+ */
+static const float aanScale[8] = {
+  1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+  1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+/**
+ * Scaled forward 8-point DCT-II of d[0], d[step], ..., d[7 * step], in
+ * place, with the AAN factorization (5 multiplications, as IJG jfdctflt).
+ */
+static inline void fdct8(float *d, int step) {
+  float tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+  float tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+  float tmp2 = d[2 * step] + d[5 * step], tmp5 = d[2 * step] - d[5 * step];
+  float tmp3 = d[3 * step] + d[4 * step], tmp4 = d[3 * step] - d[4 * step];
+
+  // even part
+  float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+  float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+  float z1 = (tmp12 + tmp13) * 0.707106781f;
+
+  d[0] = tmp10 + tmp11;
+  d[4 * step] = tmp10 - tmp11;
+  d[2 * step] = tmp13 + z1;
+  d[6 * step] = tmp13 - z1;
+
+  // odd part
+  tmp10 = tmp4 + tmp5;
+  tmp11 = tmp5 + tmp6;
+  tmp12 = tmp6 + tmp7;
+
+  float z5 = (tmp10 - tmp12) * 0.382683433f;
+  float z2 = 0.541196100f * tmp10 + z5;
+  float z4 = 1.306562965f * tmp12 + z5;
+  float z3 = tmp11 * 0.707106781f;
+  float z11 = tmp7 + z3, z13 = tmp7 - z3;
+
+  d[5 * step] = z13 + z2;
+  d[3 * step] = z13 - z2;
+  d[step] = z11 + z4;
+  d[7 * step] = z11 - z4;
+}
+
+/**
+ * Inverse of fdct8() up to the scale: the input has to be multiplied by
+ * aanScale[k] / sqrt(8) first (as IJG jidctflt).
+ */
+static inline void idct8(float *d, int step) {
+  // even part
+  float tmp0 = d[0], tmp1 = d[2 * step], tmp2 = d[4 * step], tmp3 = d[6 * step];
+  float tmp10 = tmp0 + tmp2, tmp11 = tmp0 - tmp2;
+  float tmp13 = tmp1 + tmp3;
+  float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+
+  tmp0 = tmp10 + tmp13;
+  tmp3 = tmp10 - tmp13;
+  tmp1 = tmp11 + tmp12;
+  tmp2 = tmp11 - tmp12;
+
+  // odd part
+  float z13 = d[5 * step] + d[3 * step], z10 = d[5 * step] - d[3 * step];
+  float z11 = d[step] + d[7 * step], z12 = d[step] - d[7 * step];
+  float tmp7 = z11 + z13;
+  float z5 = (z10 + z12) * 1.847759065f;
+
+  tmp11 = (z11 - z13) * 1.414213562f;
+  tmp10 = 1.082392200f * z12 - z5;
+  tmp12 = -2.613125930f * z10 + z5;
+
+  float tmp6 = tmp12 - tmp7;
+  float tmp5 = tmp11 - tmp6;
+  float tmp4 = tmp10 + tmp5;
+
+  d[0] = tmp0 + tmp7;
+  d[7 * step] = tmp0 - tmp7;
+  d[step] = tmp1 + tmp6;
+  d[6 * step] = tmp1 - tmp6;
+  d[2 * step] = tmp2 + tmp5;
+  d[5 * step] = tmp2 - tmp5;
+  d[4 * step] = tmp3 + tmp4;
+  d[3 * step] = tmp3 - tmp4;
+}
+
+/**
+ * Fills the twiddle factors of dct4(): w[2n], w[2n + 1] are scale times
+ * the cosine and sine of pi (4n + 1) / 32, w[8 + 2k], w[9 + 2k] the cosine
+ * and sine of pi k / 8, for n, k = 0..3.
+ */
+static void dct4Twiddles(float *w, float scale) {
+  for (int n = 0; n < 4; n++) {
+    w[2 * n] = scale * cos(M_PI * (4 * n + 1) / 32.0);
+    w[2 * n + 1] = scale * sin(M_PI * (4 * n + 1) / 32.0);
+    w[8 + 2 * n] = cos(M_PI * n / 8.0);
+    w[9 + 2 * n] = sin(M_PI * n / 8.0);
+  }
+}
+
+/**
+ * Scaled 8-point DCT-IV, x[k] = scale sum x[n] cos(pi (2n + 1)(2k + 1) / 32),
+ * in place, through a 4-point complex FFT: the inputs are paired into
+ * z[n] = (x[2n] + i x[7 - 2n]) e^(-i pi (4n + 1) / 32), transformed with
+ * additions only, and Z[k] e^(-i pi k / 8) gives x[2k] as its real part and
+ * x[7 - 2k] as minus its imaginary part. That is 28 multiplications
+ * instead of 64. The DCT-IV is its own inverse up to the scale.
+ * @param w Twiddle factors from dct4Twiddles().
+ */
+static inline void dct4(float *x, const float *w) {
+  float re[4], im[4], tr[4], ti[4];
+  int n, k;
+
+  for (n = 0; n < 4; n++) {
+    float a = x[2 * n], b = x[7 - 2 * n];
+    re[n] = a * w[2 * n] + b * w[2 * n + 1];
+    im[n] = b * w[2 * n] - a * w[2 * n + 1];
+  }
+
+  tr[0] = (re[0] + re[2]) + (re[1] + re[3]);
+  ti[0] = (im[0] + im[2]) + (im[1] + im[3]);
+  tr[2] = (re[0] + re[2]) - (re[1] + re[3]);
+  ti[2] = (im[0] + im[2]) - (im[1] + im[3]);
+  tr[1] = (re[0] - re[2]) + (im[1] - im[3]);
+  ti[1] = (im[0] - im[2]) - (re[1] - re[3]);
+  tr[3] = (re[0] - re[2]) - (im[1] - im[3]);
+  ti[3] = (im[0] - im[2]) + (re[1] - re[3]);
+
+  x[0] = tr[0];
+  x[7] = -ti[0];
+  for (k = 1; k < 4; k++) {
+    const float c = w[8 + 2 * k], s = w[9 + 2 * k];
+    x[2 * k] = tr[k] * c + ti[k] * s;
+    x[7 - 2 * k] = tr[k] * s - ti[k] * c;
+  }
+}
+
+/**
+ * Orthonormal forward 16-point DCT-II, in place. The even outputs are the
+ * 8-point DCT of x[n] + x[15 - n] (through fdct8()), the odd outputs the
+ * 8-point DCT-IV of x[n] - x[15 - n] (through dct4(), scaled by
+ * 1 / (2 sqrt(2))).
+ */
+static inline void fdct16(float *d, int step, const float *w) {
+  float a[8], b[8];
+  int k, n;
+
+  for (n = 0; n < 8; n++) {
+    a[n] = d[n * step] + d[(15 - n) * step];
+    b[n] = d[n * step] - d[(15 - n) * step];
+  }
+  fdct8(a, 1);
+  dct4(b, w);
+  for (k = 0; k < 8; k++) {
+    d[2 * k * step] = a[k] * 0.25f / aanScale[k];        // 1 / (sqrt(2) sqrt(8) aanScale)
+    d[(2 * k + 1) * step] = b[k];
+  }
+}
+
+/**
+ * Orthonormal inverse 16-point DCT (DCT-III), in place. The DCT-IV of the
+ * odd inputs is scaled by 1 / sqrt(2).
+ */
+static inline void idct16(float *d, int step, const float *w) {
+  float a[8], b[8];
+  int k, n;
+
+  for (k = 0; k < 8; k++) {
+    a[k] = d[2 * k * step] * 0.5f * aanScale[k];         // sqrt(2) aanScale / sqrt(8)
+    b[k] = d[(2 * k + 1) * step];
+  }
+  idct8(a, 1);
+  dct4(b, w);
+  for (n = 0; n < 8; n++) {
+    d[n * step] = 0.5f * (a[n] + b[n]);
+    d[(15 - n) * step] = 0.5f * (a[n] - b[n]);
+  }
+}
+
+/**
+ * Blockwise forward DCT (DCT-II), as used by JPEG. The image is cut into
+ * blockSize x blockSize blocks; the partial blocks at the right and bottom
+ * are padded by repeating the last column and row. Each block goes
+ * through a separable fast transform (the AAN factorization for 8 x 8; for
+ * 16 x 16 an even/odd split into an AAN 8-point DCT and an 8-point DCT-IV
+ * computed through a 4-point complex FFT),
+ * rows first, then columns. The descaling of the AAN outputs and the
+ * optional quantization are folded into one multiplication per
+ * coefficient. The blocks are spread over the threads.
+ * @param blockSize 8 or 16.
+ * @param quant Optional quantization table, blockSize x blockSize steps in
+ *        row-major (u, v) order. When given, every coefficient is divided
+ *        by its step and rounded to the nearest integer.
+ * @return The coefficients in the same block layout: coefficient (u, v) of
+ *         a block sits at (u, v) inside it. The size is rounded up to a
+ *         multiple of blockSize. The transform is orthonormal, so the DC
+ *         term is blockSize times the block mean.
+ */
+Image Image::blockDCT(int blockSize, const float *quant) {
+  Image temp;
+  int n = blockSize;
+  int blocksDown = (nrows + n - 1) / n, blocksAcross = (ncols + n - 1) / n;
+  int b, u, v;
+  float scale[256], w[16];
+
+  if (n != 8 && n != 16) {
+    cout << "blockDCT: Block size must be 8 or 16\n";
+    exit(3);
+  }
+
+  // descaling of the AAN outputs, divided by the quantization step
+  for (u = 0; u < n; u++)
+    for (v = 0; v < n; v++) {
+      scale[u * n + v] = n == 8 ? 1.0f / (8 * aanScale[u] * aanScale[v]) : 1.0f;
+      if (quant != NULL) {
+        if (quant[u * n + v] <= 0) {
+          cout << "blockDCT: Quantization steps must be positive\n";
+          exit(3);
+        }
+        scale[u * n + v] /= quant[u * n + v];
+      }
+    }
+  dct4Twiddles(w, 0.5 * M_SQRT1_2);
+
+  temp.createImage(blocksDown * n, blocksAcross * n);
+
+#pragma omp parallel for private(u, v)
+  for (b = 0; b < blocksDown * blocksAcross; b++) {
+    int r0 = (b / blocksAcross) * n, c0 = (b % blocksAcross) * n;
+    float blk[256];
+
+    for (u = 0; u < n; u++) {
+      const float *src = &image[min(r0 + u, nrows - 1) * stride];
+      for (v = 0; v < n; v++)
+        blk[u * n + v] = src[min(c0 + v, ncols - 1)];
+    }
+
+    if (n == 8) {
+      for (u = 0; u < 8; u++)
+        fdct8(&blk[u * 8], 1);
+      for (v = 0; v < 8; v++)
+        fdct8(&blk[v], 8);
+    }
+    else {
+      for (u = 0; u < 16; u++)
+        fdct16(&blk[u * 16], 1, w);
+      for (v = 0; v < 16; v++)
+        fdct16(&blk[v], 16, w);
+    }
+
+    for (u = 0; u < n; u++) {
+      float *dst = &temp(r0 + u, c0);
+      for (v = 0; v < n; v++) {
+        float c = blk[u * n + v] * scale[u * n + v];
+        dst[v] = quant != NULL ? round(c) : c;
+      }
+    }
+  }
+
+  return temp;
+}
+
+/**
+ * Blockwise inverse DCT (DCT-III) of coefficients laid out as blockDCT()
+ * makes them. The dequantization and the prescaling the AAN inverse needs
+ * are folded into one multiplication per coefficient before the transform.
+ * @param rows Height of the result, at most the coefficient height; 0 for
+ *        all of it. Use the size of the original image to drop the padding.
+ * @param cols Width of the result, 0 for all of it.
+ * @param blockSize 8 or 16, as given to blockDCT().
+ * @param quant The quantization table given to blockDCT(), or NULL.
+ * @return The reconstructed image.
+ */
+Image Image::blockIDCT(int rows, int cols, int blockSize, const float *quant) {
+  Image temp;
+  int n = blockSize;
+  int blocksDown, blocksAcross;
+  int b, u, v;
+  float scale[256], w[16];
+
+  if (rows == 0)
+    rows = nrows;
+  if (cols == 0)
+    cols = ncols;
+  if (n != 8 && n != 16) {
+    cout << "blockIDCT: Block size must be 8 or 16\n";
+    exit(3);
+  }
+  if (nrows % n != 0 || ncols % n != 0 || rows < 0 || cols < 0 ||
+      rows > nrows || cols > ncols) {
+    cout << "blockIDCT: Coefficients do not cover the requested size\n";
+    exit(3);
+  }
+  blocksDown = (rows + n - 1) / n;
+  blocksAcross = (cols + n - 1) / n;
+
+  for (u = 0; u < n; u++)
+    for (v = 0; v < n; v++) {
+      scale[u * n + v] = n == 8 ? aanScale[u] * aanScale[v] / 8 : 1.0f;
+      if (quant != NULL)
+        scale[u * n + v] *= quant[u * n + v];
+    }
+  dct4Twiddles(w, M_SQRT1_2);
+
+  temp.createImage(rows, cols);
+
+#pragma omp parallel for private(u, v)
+  for (b = 0; b < blocksDown * blocksAcross; b++) {
+    int r0 = (b / blocksAcross) * n, c0 = (b % blocksAcross) * n;
+    float blk[256];
+
+    for (u = 0; u < n; u++) {
+      const float *src = &image[(r0 + u) * stride + c0];
+      for (v = 0; v < n; v++)
+        blk[u * n + v] = src[v] * scale[u * n + v];
+    }
+
+    if (n == 8) {
+      for (v = 0; v < 8; v++)
+        idct8(&blk[v], 8);
+      for (u = 0; u < 8; u++)
+        idct8(&blk[u * 8], 1);
+    }
+    else {
+      for (v = 0; v < 16; v++)
+        idct16(&blk[v], 16, w);
+      for (u = 0; u < 16; u++)
+        idct16(&blk[u * 16], 1, w);
+    }
+
+    for (u = 0; u < n && r0 + u < rows; u++) {
+      float *dst = &temp(r0 + u, c0);
+      for (v = 0; v < n && c0 + v < cols; v++)
+        dst[v] = blk[u * n + v];
+    }
+  }
+
+  return temp;
+}
+
+/**
+ * One lifting step over n samples of width floats each, sample i at
+ * s[i * width]: every sample of the parity of first gets coeff times the
+ * sum of its two neighbours added. The neighbours are mirrored at the
+ * ends (whole-sample symmetric extension).
+ */
+static void liftStep(float *s, int n, int width, int first, float coeff) {
+  for (int i = first; i < n; i += 2) {
+    float *x = &s[(size_t) i * width];
+    const float *l = &s[(size_t) (i > 0 ? i - 1 : i + 1) * width];
+    const float *r = &s[(size_t) (i + 1 < n ? i + 1 : i - 1) * width];
+    for (int k = 0; k < width; k++)
+      x[k] += coeff * (l[k] + r[k]);
+  }
+}
+
+/**
+ * Integer lifting step of the reversible 5/3 wavelet:
+ * x += sign * floor((left + right + offset) / divisor).
+ */
+static void liftStepInt(float *s, int n, int width, int first, int sign,
+                        float offset, float divisor) {
+  for (int i = first; i < n; i += 2) {
+    float *x = &s[(size_t) i * width];
+    const float *l = &s[(size_t) (i > 0 ? i - 1 : i + 1) * width];
+    const float *r = &s[(size_t) (i + 1 < n ? i + 1 : i - 1) * width];
+    for (int k = 0; k < width; k++)
+      x[k] += sign * floor((l[k] + r[k] + offset) / divisor);
+  }
+}
+
+// CDF 9/7 lifting coefficients and scale (as in JPEG 2000)
+#define CDF97_ALPHA -1.586134342f
+#define CDF97_BETA  -0.05298011854f
+#define CDF97_GAMMA  0.8829110762f
+#define CDF97_DELTA  0.4435068522f
+#define CDF97_K      1.230174105f
+
+/**
+ * Forward or inverse lifting of n interleaved samples of width floats
+ * each. Forward leaves the lowpass coefficients on the even samples and
+ * the highpass ones on the odd samples; inverse undoes exactly that. All
+ * three wavelets share one band normalization: the lowpass has gain 1 at
+ * DC and the highpass gain 2 at Nyquist, so a constant line keeps its
+ * value in the lowpass band and +a, -a, +a, ... gives 2a in the highpass
+ * band. For CDF 9/7 that means scaling by 1/K and K after the lifting
+ * steps (JPEG 2000 uses K/2 for the highpass, i.e. Nyquist gain 1).
+ */
+static void liftLine(float *s, int n, int width, int wavelet, bool inverse) {
+  int i, k;
+
+  if (n < 2)
+    return;
+
+  if (wavelet == HAAR) {
+    for (i = 1; i < n; i += 2) {
+      float *even = &s[(size_t) (i - 1) * width], *odd = &s[(size_t) i * width];
+      for (k = 0; k < width; k++) {
+        if (!inverse) {
+          odd[k] -= even[k];
+          even[k] += odd[k] / 2;
+        }
+        else {
+          even[k] -= odd[k] / 2;
+          odd[k] += even[k];
+        }
+      }
+    }
+  }
+  else if (wavelet == CDF53) {
+    if (!inverse) {
+      liftStepInt(s, n, width, 1, -1, 0, 2);
+      liftStepInt(s, n, width, 0, 1, 2, 4);
+    }
+    else {
+      liftStepInt(s, n, width, 0, -1, 2, 4);
+      liftStepInt(s, n, width, 1, 1, 0, 2);
+    }
+  }
+  else {
+    if (!inverse) {
+      liftStep(s, n, width, 1, CDF97_ALPHA);
+      liftStep(s, n, width, 0, CDF97_BETA);
+      liftStep(s, n, width, 1, CDF97_GAMMA);
+      liftStep(s, n, width, 0, CDF97_DELTA);
+    }
+    for (i = 0; i < n; i++) {
+      float f = i % 2 == 0 ? 1 / CDF97_K : CDF97_K;
+      if (inverse)
+        f = 1 / f;
+      float *x = &s[(size_t) i * width];
+      for (k = 0; k < width; k++)
+        x[k] *= f;
+    }
+    if (inverse) {
+      liftStep(s, n, width, 0, -CDF97_DELTA);
+      liftStep(s, n, width, 1, -CDF97_GAMMA);
+      liftStep(s, n, width, 0, -CDF97_BETA);
+      liftStep(s, n, width, 1, -CDF97_ALPHA);
+    }
+  }
+}
+
+/**
+ * One level of the 2D wavelet transform over the top-left h x w part of a
+ * buffer, in place. Each row is lifted in a line buffer and written back
+ * with its lowpass half first; the columns are lifted TILESIZE at a time
+ * in a strip buffer, so every lifting step runs along whole rows of the
+ * strip, and written back with the lowpass rows first. Inverse does the
+ * columns, then the rows.
+ */
+static void waveletLevel(float *img, int stride, int h, int w, int wavelet, bool inverse) {
+  int rows, c0, pass;
+
+  for (pass = 0; pass < 2; pass++) {
+    if ((pass == 0) != inverse) {
+      int low = (w + 1) / 2;
+
+#pragma omp parallel
+      {
+        vector<float> line(w);
+        int k;
+
+#pragma omp for
+        for (rows = 0; rows < h; rows++) {
+          float *p = &img[(long) rows * stride];
+          if (!inverse) {
+            memcpy(&line[0], p, w * sizeof(float));
+            liftLine(&line[0], w, 1, wavelet, false);
+            for (k = 0; k < w; k++)
+              p[k % 2 == 0 ? k / 2 : low + k / 2] = line[k];
+          }
+          else {
+            for (k = 0; k < w; k++)
+              line[k] = p[k % 2 == 0 ? k / 2 : low + k / 2];
+            liftLine(&line[0], w, 1, wavelet, true);
+            memcpy(p, &line[0], w * sizeof(float));
+          }
+        }
+      }
+    }
+    else {
+      int low = (h + 1) / 2;
+
+#pragma omp parallel
+      {
+        vector<float> strip((size_t) h * TILESIZE);
+        int r;
+
+#pragma omp for schedule(dynamic)
+        for (c0 = 0; c0 < w; c0 += TILESIZE) {
+          int width = min(TILESIZE, w - c0);
+          for (r = 0; r < h; r++) {
+            int from = inverse ? (r % 2 == 0 ? r / 2 : low + r / 2) : r;
+            memcpy(&strip[(size_t) r * width], &img[(long) from * stride + c0],
+                   width * sizeof(float));
+          }
+          liftLine(&strip[0], h, width, wavelet, inverse);
+          for (r = 0; r < h; r++) {
+            int to = inverse ? r : (r % 2 == 0 ? r / 2 : low + r / 2);
+            memcpy(&img[(long) to * stride + c0], &strip[(size_t) r * width],
+                   width * sizeof(float));
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Multi-level 2D discrete wavelet transform by lifting, in place. Each
+ * level splits the current lowpass band into four quarter bands (Mallat
+ * layout: LL top-left, HL top-right, LH bottom-left, HH bottom-right) and
+ * the next level works on LL. Odd sizes give the lowpass half the extra
+ * sample. Only a line buffer and one TILESIZE-wide column strip per thread
+ * are allocated.
+ * @param levels Number of decomposition levels.
+ * @param wavelet HAAR, CDF53 (integer, reversible: integer input comes back
+ *        exactly) or CDF97 (the JPEG 2000 lossy wavelet). All three give
+ *        the lowpass bands gain 1 at DC and the highpass bands gain 2 at
+ *        Nyquist.
+ * @return The image itself.
+ */
+Image & Image::waveletTransform(int levels, int wavelet) {
+  int h = nrows, w = ncols;
+
+  if (levels < 0 || (wavelet != HAAR && wavelet != CDF53 && wavelet != CDF97)) {
+    cout << "waveletTransform: Unknown wavelet or negative level count\n";
+    exit(3);
+  }
+  for (int l = 0; l < levels; l++) {
+    waveletLevel(image, stride, h, w, wavelet, false);
+    h = (h + 1) / 2;
+    w = (w + 1) / 2;
+  }
+
+  return *this;
+}
+
+/**
+ * Inverse of waveletTransform(), in place.
+ * @param levels Number of levels the image was decomposed into.
+ * @param wavelet The wavelet it was decomposed with.
+ * @return The image itself.
+ */
+Image & Image::inverseWaveletTransform(int levels, int wavelet) {
+  int l, h, w;
+
+  if (levels < 0 || (wavelet != HAAR && wavelet != CDF53 && wavelet != CDF97)) {
+    cout << "inverseWaveletTransform: Unknown wavelet or negative level count\n";
+    exit(3);
+  }
+  for (l = levels - 1; l >= 0; l--) {
+    h = nrows;
+    w = ncols;
+    for (int k = 0; k < l; k++) {
+      h = (h + 1) / 2;
+      w = (w + 1) / 2;
+    }
+    waveletLevel(image, stride, h, w, wavelet, true);
+  }
+
+  return *this;
+}
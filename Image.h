@@ -28,6 +28,31 @@
 
 using namespace std;
 
+// Edge length of the blocks and strips used by the blocked passes. Pixels
+// always stay row-major: the column-heavy passes (transpose, filterCols,
+// the DFT column pass, the recursive and wavelet column passes) walk the
+// row-major buffer in TILESIZE-wide strips or TILESIZE x TILESIZE blocks
+// instead of converting to a tiled layout, which would cost two extra
+// copies of the image per call.
+#define TILESIZE 64
+
+// sampling used by the geometric transforms
+enum Interpolation { NEAREST, BILINEAR, BICUBIC };
+
+// wavelets of waveletTransform()
+enum Wavelet { HAAR, CDF53, CDF97 };
+
+// statistics of one connected component, filled in by labelComponents()
+struct Region {
+  int label;			// label value of the component in the label image
+  int area;			// number of pixels
+  int top, left;		// bounding box, inclusive
+  int bottom, right;
+  double centroidRow;		// mean row / column of the pixels
+  double centroidCol;
+  double sum;			// sum of the pixel intensities
+};
+
 class Image {
   friend ostream & operator<<(ostream &, Image &);
   friend Image operator/(Image &, double);    // image divided by a scalar
@@ -40,6 +65,7 @@ class Image {
   Image();                             // default constructor
   Image(int, int);                     // constructor with row & column
   Image(const Image &);                // copy constructor
+  Image(int, int, float *, int stride = 0);  // wrap an existing buffer, no copy
   ~Image();                            // destructor
 
 
@@ -53,8 +79,10 @@ class Image {
   // get and set functions
   int getRow() const;                  	// get row # / the height of the img
   int getCol() const;                  	// get col # / the width of the image
+  int getStride() const;               	// get the distance between two rows in the buffer
   float getMaximum() const;            	// get the maximum pixel value
   float getMinimum() const;            	// get the mininum pixel value
+  uint64_t hash() const;               	// 64-bit hash of the size and pixels
   float getPix(int rows, int cols);		// get pixel value at (rows, cols)
   Image getImage() const;              	// get the image
 
@@ -62,6 +90,7 @@ class Image {
   void setCol(int);                    // set column number
   void setPix(int rows, int cols, float value);	// set Pixel value at (rows, cols)
   void setImage(Image &);              // set the image,
+  Image view(int row, int col, int height, int width);	// window onto this image, no copy
 
   // operator overloading functions
   float & operator()(int, int c = 0) const; // operator overloading (i,j), when c = 0, a column vector
@@ -70,11 +99,19 @@ class Image {
   Image operator-(const Image &) const;    // overloading - operator
   Image operator*(const Image &) const;    // overloading pixelwise *
   Image operator/(const Image &) const;    // overloading pixelwise division
+  Image & operator+=(const Image &);       // in-place pixelwise +
+  Image & operator-=(const Image &);       // in-place pixelwise -
+  Image & operator*=(const Image &);       // in-place pixelwise *
+  Image & operator*=(double);              // in-place scaling
 
   bool IsEmpty() const { return (image==NULL); }
 
-  void readImage(char *fname);
-  void writeImage(char *fname, bool flag = false);
+  bool readImage(char *fname);         // false, after a message, on failure
+  bool writeImage(char *fname, bool flag = false);
+  bool readFloatImage(char *fname, size_t start = 0,   // read a float PFM, mapped in place when possible
+                      string *metadata = NULL);
+  bool writeFloatImage(char *fname, const string &prefix = "",  // write the float buffer losslessly as PFM
+                       const string &metadata = "");            // with metadata behind the pixels
 
   // YOUR MEMBER FUNCTIONS //
 
@@ -87,6 +124,26 @@ Image customImg();
 Image DFT();
 Image IDFT();
 
+Image transpose();						// blocked transpose
+Image filterRows(const float *kernel, int ksize);	// horizontal 1-D filter, clamped borders
+Image filterCols(const float *kernel, int ksize);	// vertical 1-D filter, clamped borders
+Image labelComponents(vector<Region> &regions, int connectivity = 8, float background = 0.0);
+Image warpAffine(const float *matrix, int outRows = 0, int outCols = 0,	// 2x3 output-to-source map
+		 int interpolation = BILINEAR, float fill = 0.0);
+Image warpPerspective(const float *matrix, int outRows = 0, int outCols = 0,	// 3x3 output-to-source map
+		      int interpolation = BILINEAR, float fill = 0.0);
+Image rotate(float angle, int interpolation = BILINEAR, float fill = 0.0);	// about the centre, degrees
+Image sobel(Image &direction);			// gradient magnitude, direction quantized to 0..3
+Image canny(float lowThreshold, float highThreshold);	// edge map, 255 on the edges
+Image gaussianBlur(float sigma);		// recursive Gaussian, cost independent of sigma
+Image bilateralFilter(float sigmaSpatial, float sigmaRange, float sampling = 1.0);	// bilateral grid
+Image distanceTransform(float featureValue = 0.0);	// Euclidean distance to the nearest feature pixel
+Image distanceTransform(Image &nearestRow, Image &nearestCol, float featureValue = 0.0);	// ... and where that pixel is
+Image blockDCT(int blockSize = 8, const float *quant = NULL);	// JPEG-style blockwise DCT, optionally quantized
+Image blockIDCT(int rows = 0, int cols = 0, int blockSize = 8, const float *quant = NULL);	// its inverse, cropped to rows x cols
+Image & waveletTransform(int levels = 1, int wavelet = CDF97);	// in-place lifting DWT, Mallat layout
+Image & inverseWaveletTransform(int levels = 1, int wavelet = CDF97);	// its inverse, in place
+
   // END OF YOUR MEMBER FUNCTIONS//
 
  private:
@@ -94,6 +151,12 @@ Image IDFT();
   int ncols;		// number of columns / width
   int maximum;		// the maximum pixel value
   float *image;		// image buffer
+  int stride;		// floats from the start of one row to the next
+  char *mapping;	// file mapping the buffer lives in, NULL when on the heap
+  size_t mappingSize;	// length of the mapping in bytes
+  bool borrowed;	// buffer belongs to someone else, never freed here
+
+  void freeImage();	// release the buffer, wherever it came from
 };
 
 
@@ -0,0 +1,212 @@
+/**********************************************************
+ * ImageSequence.cpp - the frame sequence processor which
+ *                     implements the member functions defined
+ *                     in ImageSequence.h
+ **********************************************************/
+
+#include "ImageSequence.h"
+
+using namespace std;
+
+/**
+ * Constructor. Allocates the ring and every model buffer up front.
+ * @param rows Frame height.
+ * @param cols Frame width.
+ * @param depth Number of frames kept in the ring.
+ * @param alpha Learning rate of the exponential background model.
+ */
+ImageSequence::ImageSequence(int rows, int cols, int depth, float alpha) {
+  int k;
+
+  if (rows <= 0 || cols <= 0 || depth <= 0) {
+    cout << "ImageSequence: Index out of range.\n";
+    exit(3);
+  }
+
+  nrows = rows;
+  ncols = cols;
+  this->depth = depth;
+  this->alpha = alpha;
+  head = -1;
+  count = 0;
+
+  ring = new Image [depth];
+  for (k = 0; k < depth; k++)
+    ring[k].createImage(nrows, ncols);
+  total = new double [nrows * ncols]();
+  average.createImage(nrows, ncols);
+  model.createImage(nrows, ncols);
+  diff.createImage(nrows, ncols);
+  med.createImage(nrows, ncols);
+}
+
+/**
+ * Destructor. Frees the ring and the running sum.
+ */
+ImageSequence::~ImageSequence() {
+  delete [] ring;
+  delete [] total;
+}
+
+/**
+ * Adds a frame. The frame is copied over the oldest slot of the ring, and
+ * the running average, the background model and the frame difference are
+ * updated in place. No buffer is allocated.
+ * @param frame The new frame, must be rows x cols.
+ */
+void ImageSequence::push(Image &frame) {
+  int rows, i;
+  int slot = (head + 1) % depth;
+
+  if (frame.getRow() != nrows || frame.getCol() != ncols) {
+    cout << "ImageSequence::push: Frame is not of the sequence size\n";
+    exit(3);
+  }
+
+  // the frame may be a view, so it is walked row by row
+  for (rows = 0; rows < nrows; rows++) {
+    const float *in = &frame(rows, 0);
+    float *avg = &average(rows, 0);
+    float *bg = &model(rows, 0);
+    double *sum = &total[rows * ncols];
+    int n = min(count + 1, depth);
+
+    // running average over the ring: add the new frame, drop the one it
+    // replaces. The sum is kept in double, where adding and removing the
+    // same float leaves no residue, so the average does not drift
+    if (count < depth) {
+      for (i = 0; i < ncols; i++)
+        sum[i] += in[i];
+    }
+    else {
+      const float *old = &ring[slot](rows, 0);
+      for (i = 0; i < ncols; i++)
+        sum[i] += (double) in[i] - old[i];
+    }
+    for (i = 0; i < ncols; i++)
+      avg[i] = sum[i] / n;
+
+    // exponential background, started from the first frame
+    if (count > 0)
+      for (i = 0; i < ncols; i++)
+        bg[i] += alpha * (in[i] - bg[i]);
+  }
+  if (count == 0)
+    model.setImage(frame);
+
+  ring[slot].setImage(frame);
+  head = slot;
+  if (count < depth)
+    count++;
+
+  // frame difference, zero until there are two frames
+  if (count > 1) {
+    diff.setImage(ring[head]);
+    diff -= getFrame(1);
+    float *d = &diff(0, 0);
+    for (i = 0; i < nrows * ncols; i++)
+      d[i] = fabs(d[i]);
+  }
+}
+
+/**
+ * Returns the frame height.
+ * @return Number of rows.
+ */
+int ImageSequence::getRow() const {
+  return nrows;
+}
+
+/**
+ * Returns the frame width.
+ * @return Number of columns.
+ */
+int ImageSequence::getCol() const {
+  return ncols;
+}
+
+/**
+ * Returns the number of slots in the ring.
+ * @return The ring depth.
+ */
+int ImageSequence::getDepth() const {
+  return depth;
+}
+
+/**
+ * Returns how many frames the ring holds, at most the depth.
+ * @return Number of valid frames.
+ */
+int ImageSequence::getCount() const {
+  return count;
+}
+
+/**
+ * Returns a frame of the ring.
+ * @param k 0 for the newest frame, 1 for the one before it, ...
+ * @return The frame buffer; it is overwritten by later push() calls.
+ */
+Image & ImageSequence::getFrame(int k) {
+  if (k < 0 || k >= count) {
+    cout << "ImageSequence::getFrame: Frame " << k << " is not in the ring\n";
+    exit(3);
+  }
+  return ring[(head - k + depth) % depth];
+}
+
+/**
+ * Returns the mean of the frames currently in the ring.
+ * @return The running average, updated by push().
+ */
+Image & ImageSequence::runningAverage() {
+  return average;
+}
+
+/**
+ * Returns the exponential background model,
+ * bg = bg + alpha * (frame - bg) for every pushed frame.
+ * @return The background, updated by push().
+ */
+Image & ImageSequence::background() {
+  return model;
+}
+
+/**
+ * Returns the absolute difference of the two newest frames.
+ * @return The difference image, updated by push().
+ */
+Image & ImageSequence::difference() {
+  return diff;
+}
+
+/**
+ * Computes the pixelwise median of the frames in the ring. For an even
+ * number of frames the upper of the two middle values is taken.
+ * @return The median image; it is recomputed on every call.
+ */
+Image & ImageSequence::median() {
+  int rows, cols, k;
+
+  if (count == 0)
+    return med;
+
+#pragma omp parallel private(cols, k)
+  {
+    vector<float> window(count);
+    vector<float *> frames(count);
+
+#pragma omp for
+    for (rows = 0; rows < nrows; rows++) {
+      for (k = 0; k < count; k++)
+        frames[k] = &getFrame(k)(rows, 0);
+      for (cols = 0; cols < ncols; cols++) {
+        for (k = 0; k < count; k++)
+          window[k] = frames[k][cols];
+        nth_element(window.begin(), window.begin() + count / 2, window.end());
+        med(rows, cols) = window[count / 2];
+      }
+    }
+  }
+
+  return med;
+}
@@ -0,0 +1,59 @@
+/********************************************************************
+ * ImageSequence.h - header file of the frame sequence processor which
+ *                   keeps a fixed ring of frames and the temporal
+ *                   models built on them
+ *
+ * Note:
+ *   Every buffer is allocated once, in the constructor. Pushing a frame
+ *   copies it into the oldest slot of the ring and updates the models
+ *   in place, so memory use stays the same however long the stream is.
+ *
+ ********************************************************************/
+
+#ifndef IMAGESEQUENCE_H
+#define IMAGESEQUENCE_H
+
+#include "Image.h"
+
+class ImageSequence {
+ public:
+  // constructors and destructor
+  ImageSequence(int rows, int cols,    // frame size
+                int depth = 5,         // number of frames kept in the ring
+                float alpha = 0.05);   // learning rate of the background model
+  ~ImageSequence();
+
+  void push(Image &frame);             // add a frame and update the models
+
+  // get functions
+  int getRow() const;                  // frame height
+  int getCol() const;                  // frame width
+  int getDepth() const;                // size of the ring
+  int getCount() const;                // frames in the ring, at most depth
+  Image & getFrame(int k = 0);         // the frame pushed k frames ago
+
+  // temporal operators
+  Image & runningAverage();            // mean of the frames in the ring
+  Image & background();                // exponential background model
+  Image & difference();                // |newest frame - previous frame|
+  Image & median();                    // pixelwise median of the ring
+
+ private:
+  ImageSequence(const ImageSequence &);             // not copyable
+  ImageSequence & operator=(const ImageSequence &);
+
+  int nrows;		// frame height
+  int ncols;		// frame width
+  int depth;		// number of slots in the ring
+  int head;		// slot of the newest frame
+  int count;		// number of filled slots
+  float alpha;		// learning rate of the background model
+  Image *ring;		// frame buffers
+  double *total;	// running sum of the ring, nrows * ncols
+  Image average;	// running average of the ring
+  Image model;		// exponential background
+  Image diff;		// frame difference
+  Image med;		// temporal median
+};
+
+#endif
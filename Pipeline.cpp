@@ -0,0 +1,276 @@
+/**********************************************************
+ * Pipeline.cpp - the operation pipeline which implements
+ *                the member functions defined in Pipeline.h
+ **********************************************************/
+
+#include "Pipeline.h"
+
+using namespace std;
+
+/**
+ * Constructor. Creates an empty pipeline, run() on it copies its input.
+ */
+Pipeline::Pipeline() {
+}
+
+/**
+ * Records an operation that only takes scalar parameters.
+ * @return The pipeline itself, for chaining.
+ */
+Pipeline & Pipeline::record(OpType type, double p0, double p1, double p2) {
+  Op op;
+
+  op.type = type;
+  op.p[0] = p0;
+  op.p[1] = p1;
+  op.p[2] = p2;
+  op.operand = NULL;
+  ops.push_back(op);
+
+  return *this;
+}
+
+/**
+ * Records a pixelwise operation with a second image.
+ * @return The pipeline itself, for chaining.
+ */
+Pipeline & Pipeline::record(OpType type, Image &img) {
+  record(type);
+  ops.back().operand = &img;
+
+  return *this;
+}
+
+/**
+ * Records a 1-D filter.
+ * @return The pipeline itself, for chaining.
+ */
+Pipeline & Pipeline::record(OpType type, const float *kernel, int ksize) {
+  if (ksize <= 0 || ksize % 2 == 0) {
+    cout << "Pipeline: Filter length must be odd\n";
+    exit(3);
+  }
+  record(type);
+  ops.back().kernel.assign(kernel, kernel + ksize);
+
+  return *this;
+}
+
+Pipeline & Pipeline::negativeImg() { return record(NEGATIVE); }
+Pipeline & Pipeline::logTransform() { return record(LOG); }
+Pipeline & Pipeline::gammaTransform(float gam) { return record(GAMMA, gam); }
+Pipeline & Pipeline::thresholdImage(float threshold, float lowValue, float highValue) {
+  return record(THRESHOLD, threshold, lowValue, highValue);
+}
+
+Pipeline & Pipeline::add(double s) { return record(ADD_SCALAR, s); }
+Pipeline & Pipeline::subtract(double s) { return record(SUB_SCALAR, s); }
+Pipeline & Pipeline::multiply(double s) { return record(MUL_SCALAR, s); }
+Pipeline & Pipeline::divide(double s) { return record(DIV_SCALAR, s); }
+
+Pipeline & Pipeline::add(Image &img) { return record(ADD_IMAGE, img); }
+Pipeline & Pipeline::subtract(Image &img) { return record(SUB_IMAGE, img); }
+Pipeline & Pipeline::multiply(Image &img) { return record(MUL_IMAGE, img); }
+Pipeline & Pipeline::divide(Image &img) { return record(DIV_IMAGE, img); }
+
+Pipeline & Pipeline::filterRows(const float *kernel, int ksize) {
+  return record(FILTER_ROWS, kernel, ksize);
+}
+Pipeline & Pipeline::filterCols(const float *kernel, int ksize) {
+  return record(FILTER_COLS, kernel, ksize);
+}
+
+/**
+ * Returns the number of recorded operations.
+ * @return The chain length.
+ */
+int Pipeline::size() const {
+  return ops.size();
+}
+
+/**
+ * Describes the chain as text: one "name(parameters)" entry per operation,
+ * separated by spaces, with the parameters printed exactly (17 digits) and
+ * the second image of an image operation given by its hash. Two chains
+ * that compute the same thing on the same operands describe the same, so
+ * the text can key a ResultCache.
+ * @return The description, empty for an empty chain.
+ */
+string Pipeline::describe() const {
+  static const char *names[] = { "negativeImg", "logTransform", "gammaTransform",
+                                 "thresholdImage", "add", "subtract", "multiply",
+                                 "divide", "add", "subtract", "multiply", "divide",
+                                 "filterRows", "filterCols" };
+  static const int scalars[] = { 0, 0, 1, 3, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0 };
+  ostringstream out;
+
+  out << setprecision(17);
+  for (size_t k = 0; k < ops.size(); k++) {
+    const Op &op = ops[k];
+
+    if (k > 0)
+      out << ' ';
+    out << names[op.type] << '(';
+    for (int i = 0; i < scalars[op.type]; i++)
+      out << (i > 0 ? "," : "") << op.p[i];
+    if (op.operand != NULL)
+      out << "image:" << hex << op.operand->hash() << dec;
+    for (size_t i = 0; i < op.kernel.size(); i++)
+      out << (i > 0 ? "," : "") << op.kernel[i];
+    out << ')';
+  }
+
+  return out.str();
+}
+
+/**
+ * Evaluates the chain on an image, one output tile at a time.
+ *
+ * Each tile is loaded together with a border wide enough for all the
+ * filters of the chain (pixels outside the image take the value of the
+ * nearest border pixel). Point and arithmetic operations then run over the
+ * tile in place; a filter writes into a second tile buffer and shrinks the
+ * part of the tile that is still valid by its radius. After a filter the
+ * positions that lie outside the image are set again from the nearest
+ * border pixel, so the result matches running the Image functions one after
+ * the other exactly, borders included.
+ * @param in The input image.
+ * @param tileSize Edge length of the output tiles, positive.
+ * @return The result of the whole chain.
+ */
+Image Pipeline::run(Image &in, int tileSize) {
+  Image temp;
+  int nrows = in.getRow();
+  int ncols = in.getCol();
+  int haloRows = 0, haloCols = 0;
+  int tilesDown, tilesAcross;
+  int t;
+
+  if (tileSize <= 0) {
+    cout << "Pipeline::run: Tile size must be positive\n";
+    exit(3);
+  }
+  tilesDown = (nrows + tileSize - 1) / tileSize;
+  tilesAcross = (ncols + tileSize - 1) / tileSize;
+
+  for (size_t k = 0; k < ops.size(); k++) {
+    if (ops[k].type == FILTER_ROWS)
+      haloCols += ops[k].kernel.size() / 2;
+    if (ops[k].type == FILTER_COLS)
+      haloRows += ops[k].kernel.size() / 2;
+    if (ops[k].operand != NULL &&
+        (ops[k].operand->getRow() != nrows || ops[k].operand->getCol() != ncols)) {
+      cout << "Pipeline::run: "
+           << "Images are not of the same size or type, can't run the pipeline\n";
+      exit(3);
+    }
+  }
+
+  temp.createImage(nrows, ncols);
+
+  const float *src = &in(0, 0);
+  int srcStride = in.getStride();            // in may be a view
+  float *dst = &temp(0, 0);
+  int height = tileSize + 2 * haloRows;      // tile buffer size
+  int width = tileSize + 2 * haloCols;
+
+#pragma omp parallel
+  {
+    vector<float> bufA(height * width), bufB(height * width);
+    float *a = &bufA[0], *b = &bufB[0];
+
+#pragma omp for schedule(dynamic)
+    for (t = 0; t < tilesDown * tilesAcross; t++) {
+      int r0 = (t / tilesAcross) * tileSize - haloRows;   // image position of buf(0,0)
+      int c0 = (t % tilesAcross) * tileSize - haloCols;
+      int h = min(tileSize, nrows - (r0 + haloRows)) + 2 * haloRows;
+      int w = min(tileSize, ncols - (c0 + haloCols)) + 2 * haloCols;
+      int top = 0, bottom = h, left = 0, right = w;      // valid part of buf
+      int rows, cols, i, half, r;
+
+      for (rows = 0; rows < h; rows++)
+        for (cols = 0; cols < w; cols++)
+          a[rows * width + cols] =
+            src[min(max(r0 + rows, 0), nrows - 1) * srcStride + min(max(c0 + cols, 0), ncols - 1)];
+
+      for (size_t k = 0; k < ops.size(); k++) {
+        const Op &op = ops[k];
+        const float *operand = op.operand ? &(*op.operand)(0, 0) : NULL;
+
+        if (op.type == FILTER_ROWS || op.type == FILTER_COLS) {
+          half = op.kernel.size() / 2;
+          if (op.type == FILTER_ROWS) {
+            left += half;
+            right -= half;
+          }
+          else {
+            top += half;
+            bottom -= half;
+          }
+          for (rows = top; rows < bottom; rows++)
+            for (cols = left; cols < right; cols++) {
+              float sum = 0;
+              for (i = -half; i <= half; i++)
+                sum += op.kernel[i + half] * (op.type == FILTER_ROWS ?
+                                              a[rows * width + cols + i] :
+                                              a[(rows + i) * width + cols]);
+              b[rows * width + cols] = sum;
+            }
+          swap(a, b);
+
+          // positions outside the image repeat the nearest border pixel
+          for (rows = top; rows < bottom; rows++)
+            for (cols = left; cols < right; cols++) {
+              int rr = min(max(r0 + rows, 0), nrows - 1) - r0;
+              int cc = min(max(c0 + cols, 0), ncols - 1) - c0;
+              if (rr != rows || cc != cols)
+                a[rows * width + cols] = a[rr * width + cc];
+            }
+          continue;
+        }
+
+        for (rows = top; rows < bottom; rows++) {
+          float *p = &a[rows * width];
+          const float *q = operand ?
+            &operand[min(max(r0 + rows, 0), nrows - 1) * op.operand->getStride()] : NULL;
+          for (cols = left; cols < right; cols++) {
+            switch (op.type) {
+            case NEGATIVE:
+              r = (int) p[cols];
+              p[cols] = 255 - 1 - r;
+              break;
+            case LOG:
+              r = (int) p[cols];
+              p[cols] = (log(1 + r)) * (255 / log(1 + 255));
+              break;
+            case GAMMA:
+              r = (int) p[cols];
+              p[cols] = pow(r, (float) op.p[0]) * (255 / pow(255, (float) op.p[0]));
+              break;
+            case THRESHOLD:
+              p[cols] = p[cols] <= (float) op.p[0] ? op.p[1] : op.p[2];
+              break;
+            case ADD_SCALAR: p[cols] = p[cols] + op.p[0]; break;
+            case SUB_SCALAR: p[cols] = p[cols] - op.p[0]; break;
+            case MUL_SCALAR: p[cols] = p[cols] * op.p[0]; break;
+            case DIV_SCALAR: p[cols] = p[cols] / op.p[0]; break;
+            default: {
+              float v = q[min(max(c0 + cols, 0), ncols - 1)];
+              if (op.type == ADD_IMAGE) p[cols] = p[cols] + v;
+              else if (op.type == SUB_IMAGE) p[cols] = p[cols] - v;
+              else if (op.type == MUL_IMAGE) p[cols] = p[cols] * v;
+              else p[cols] = p[cols] / (v + 0.001);
+            }
+            }
+          }
+        }
+      }
+
+      for (rows = haloRows; rows < h - haloRows; rows++)
+        for (cols = haloCols; cols < w - haloCols; cols++)
+          dst[(r0 + rows) * ncols + c0 + cols] = a[rows * width + cols];
+    }
+  }
+
+  return temp;
+}
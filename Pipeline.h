@@ -0,0 +1,72 @@
+/********************************************************************
+ * Pipeline.h - header file of the operation pipeline which records a
+ *              chain of Image operations and evaluates it tile by tile
+ *
+ * Note:
+ *   The operations are only recorded when the builder functions are
+ *   called. run() cuts the output into tiles, pulls each tile (plus
+ *   the border the neighborhood filters need) from the input and pushes
+ *   it through the whole chain before moving on, so the intermediate
+ *   results never leave the cache. Tiles are spread over the threads.
+ *   Every operation gives the same result as the Image member function
+ *   or operator it is named after.
+ *
+ ********************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "Image.h"
+
+class Pipeline {
+ public:
+  Pipeline();
+
+  // point operations, same as the Image member functions
+  Pipeline & negativeImg();
+  Pipeline & logTransform();
+  Pipeline & gammaTransform(float gam);
+  Pipeline & thresholdImage(float threshold = 127.0, float lowValue = 0.0, float highValue = 255.0);
+
+  // arithmetic with a scalar, same as the Image operators
+  Pipeline & add(double s);
+  Pipeline & subtract(double s);
+  Pipeline & multiply(double s);
+  Pipeline & divide(double s);
+
+  // pixelwise arithmetic with a second image, same as the Image operators;
+  // the image is referenced, not copied, and must outlive the pipeline
+  Pipeline & add(Image &img);
+  Pipeline & subtract(Image &img);
+  Pipeline & multiply(Image &img);
+  Pipeline & divide(Image &img);
+
+  // neighborhood operations, same as Image::filterRows / filterCols
+  Pipeline & filterRows(const float *kernel, int ksize);
+  Pipeline & filterCols(const float *kernel, int ksize);
+
+  int size() const;                    // number of recorded operations
+  string describe() const;             // canonical text of the chain, see ResultCache
+  Image run(Image &in, int tileSize = TILESIZE);   // evaluate the chain on in
+
+ private:
+  enum OpType { NEGATIVE, LOG, GAMMA, THRESHOLD,
+                ADD_SCALAR, SUB_SCALAR, MUL_SCALAR, DIV_SCALAR,
+                ADD_IMAGE, SUB_IMAGE, MUL_IMAGE, DIV_IMAGE,
+                FILTER_ROWS, FILTER_COLS };
+
+  struct Op {
+    OpType type;
+    double p[3];		// scalar parameters
+    Image *operand;		// second image of the image operations
+    vector<float> kernel;	// taps of the filters
+  };
+
+  vector<Op> ops;
+
+  Pipeline & record(OpType type, double p0 = 0, double p1 = 0, double p2 = 0);
+  Pipeline & record(OpType type, Image &img);
+  Pipeline & record(OpType type, const float *kernel, int ksize);
+};
+
+#endif
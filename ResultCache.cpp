@@ -0,0 +1,368 @@
+/**********************************************************
+ * ResultCache.cpp - the result cache which implements the
+ *                   member functions defined in ResultCache.h
+ **********************************************************/
+
+#include "ResultCache.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// first line of every cache file
+#define CACHE_MAGIC "img_process result cache 1"
+
+/**
+ * Constructor. With a directory, the cache files a previous run left there
+ * become the on-disk level, most recently used first by modification
+ * time; the directory is created if it does not exist. When it can't be
+ * opened the cache says so and keeps results in memory only.
+ * @param memoryBytes Most pixel bytes held in memory.
+ * @param dir Directory of the on-disk level, NULL for memory only.
+ * @param diskBytes Most file bytes held on disk.
+ */
+ResultCache::ResultCache(size_t memoryBytes, const char *dir, size_t diskBytes) {
+  memoryLimit = memoryBytes;
+  diskLimit = diskBytes;
+  this->memoryBytes = 0;
+  this->diskBytes = 0;
+  hits = diskHits = misses = 0;
+
+  if (dir == NULL)
+    return;
+
+  directory = dir;
+  mkdir(dir, 0755);
+
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    cout << "Can't open cache directory " << dir << ", caching in memory only\n";
+    directory.clear();
+    return;
+  }
+
+  vector< pair<time_t, uint64_t> > found;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    char *end;
+    uint64_t k = strtoull(e->d_name, &end, 16);
+    struct stat st;
+
+    if (end == e->d_name + 16 && strcmp(end, ".cache.part") == 0) {
+      unlink((directory + "/" + e->d_name).c_str());   // left by an interrupted write
+      continue;
+    }
+    if (end != e->d_name + 16 || strcmp(end, ".cache") != 0 ||
+        stat(fileName(k).c_str(), &st) != 0)
+      continue;
+    found.push_back(make_pair(st.st_mtime, k));
+    files[k].bytes = st.st_size;
+  }
+  closedir(d);
+
+  // oldest first, so the newest ends up in front
+  sort(found.begin(), found.end());
+  for (size_t i = 0; i < found.size(); i++)
+    keepFile(found[i].second, files[found[i].second].bytes);
+}
+
+/**
+ * Combines the input hash with a 64-bit FNV-1a hash of the chain text.
+ * The result names the disk files, so it must not change between runs.
+ */
+uint64_t ResultCache::key(uint64_t input, const string &chain) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+
+  for (size_t i = 0; i < chain.size(); i++) {
+    h ^= (unsigned char) chain[i];
+    h *= 0x100000001B3ULL;
+  }
+  h ^= input + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+  h *= 0xFF51AFD7ED558CCDULL;
+  return h ^ (h >> 33);
+}
+
+/**
+ * True for the characters that make up words and numbers in a chain text.
+ */
+static bool wordChar(char c) {
+  return isalnum((unsigned char) c) || c == '_' || c == '.';
+}
+
+/**
+ * Rewrites every decimal number in a chain text with 17 significant
+ * digits, so "gammaTransform(0.4)", "gammaTransform(0.40)" and
+ * "gammaTransform(.4)" name the same chain. Only numbers standing on their
+ * own count; digits inside a word such as "filter3x3" or a hex hash after
+ * "image:" are left alone.
+ */
+string ResultCache::canonical(const string &chain) {
+  string out;
+  const char *s = chain.c_str();
+  size_t i = 0;
+
+  while (i < chain.size()) {
+    char *end;
+    double v;
+
+    if (i > 0 && (wordChar(s[i - 1]) || s[i - 1] == ':')) {
+      out += s[i++];
+      continue;
+    }
+    v = strtod(s + i, &end);
+    if (end == s + i || !(isdigit((unsigned char) s[i]) || strchr("+-.", s[i]) != NULL) ||
+        wordChar(*end) || chain.substr(i, end - s - i).find_first_of("xXpPiInN") != string::npos) {
+      // not a number standing on its own: copy up to the end of the word
+      do
+        out += s[i++];
+      while (i < chain.size() && wordChar(s[i]));
+      continue;
+    }
+
+    char number[32];
+    snprintf(number, sizeof(number), "%.17g", v);
+    out += number;
+    i = end - s;
+  }
+
+  return out;
+}
+
+/**
+ * The header written ahead of the PFM in a cache file. The key only picks
+ * the file name, so the header keeps what the key was made from; a disk
+ * hit is only taken when the header matches byte for byte.
+ */
+string ResultCache::header(uint64_t input, const string &chain) {
+  char line[64];
+
+  snprintf(line, sizeof(line), "%s\n%016llx %zu\n", CACHE_MAGIC, (unsigned long long) input, chain.size());
+  return line + chain + "\n";
+}
+
+string ResultCache::fileName(uint64_t k) const {
+  char name[32];
+
+  snprintf(name, sizeof(name), "/%016llx.cache", (unsigned long long) k);
+  return directory + name;
+}
+
+/**
+ * Looks a result up, first in memory, then on disk. A result read from
+ * disk is moved into memory as well.
+ * @param in The input image.
+ * @param chain Text naming the operation chain and its parameters.
+ * @param result Set to the cached result on a hit, untouched on a miss.
+ * @return true on a hit.
+ */
+bool ResultCache::lookup(const Image &in, const string &chain, Image &result) {
+  return find(in.hash(), canonical(chain), result);
+}
+
+/**
+ * Remembers the result of a chain on an input, in memory and on disk.
+ * Results larger than a level's bound are not kept on that level.
+ * @param in The input image.
+ * @param chain Text naming the operation chain and its parameters.
+ * @param result The output of the chain on in.
+ */
+void ResultCache::store(const Image &in, const string &chain, Image &result) {
+  keep(in.hash(), canonical(chain), result);
+}
+
+/**
+ * Runs a pipeline through the cache: an input whose pixels and chain were
+ * seen before costs one hash and a copy of the stored result.
+ * @param pipeline The operation chain.
+ * @param in The input image.
+ * @return pipeline.run(in).
+ */
+Image ResultCache::run(Pipeline &pipeline, Image &in) {
+  Image temp;
+  uint64_t input = in.hash();
+  string chain = "Pipeline " + pipeline.describe();
+
+  if (!find(input, chain, temp)) {
+    temp = pipeline.run(in);
+    keep(input, chain, temp);
+  }
+
+  return temp;
+}
+
+bool ResultCache::find(uint64_t input, const string &chain, Image &result) {
+  uint64_t k = key(input, chain);
+  map<uint64_t, Entry>::iterator it = entries.find(k);
+
+  map<uint64_t, DiskEntry>::iterator f = files.find(k);
+
+  if (it != entries.end() && it->second.input == input && it->second.chain == chain) {
+    memoryAge.splice(memoryAge.begin(), memoryAge, it->second.age);
+    if (f != files.end())
+      touchFile(f);
+    result = it->second.result;
+    hits++;
+    return true;
+  }
+
+  if (f != files.end()) {
+    string name = fileName(k), head = header(input, chain), found(head.size(), '\0');
+    ifstream ifp(name.c_str(), ios::in | ios::binary);
+
+    ifp.read(&found[0], found.size());
+    ifp.close();
+    if (found != head) {
+      // a file of another chain or input with the same key stays; one
+      // that is gone or not a cache file at all is forgotten
+      if (found.compare(0, strlen(CACHE_MAGIC) + 1, string(CACHE_MAGIC) + "\n") != 0) {
+        unlink(name.c_str());
+        dropFile(k);
+      }
+      misses++;
+      return false;
+    }
+
+    Image temp;
+    if (!temp.readFloatImage((char *) name.c_str(), head.size())) {
+      unlink(name.c_str());
+      dropFile(k);
+      misses++;
+      return false;
+    }
+    touchFile(f);
+    keepInMemory(k, input, chain, temp);
+    result = temp;
+    hits++;
+    diskHits++;
+    return true;
+  }
+
+  misses++;
+  return false;
+}
+
+void ResultCache::keep(uint64_t input, const string &chain, Image &result) {
+  uint64_t k = key(input, chain);
+
+  keepInMemory(k, input, chain, result);
+
+  if (directory.empty() || files.count(k))
+    return;
+
+  // written under a temporary name first, so a crash never leaves half a
+  // file; a result that can't be written stays in memory only
+  string name = fileName(k), part = name + ".part";
+  struct stat st;
+
+  if (!result.writeFloatImage((char *) part.c_str(), header(input, chain)) ||
+      rename(part.c_str(), name.c_str()) != 0 || stat(name.c_str(), &st) != 0) {
+    cout << "Can't write cache file " << name << endl;
+    unlink(part.c_str());
+    return;
+  }
+  keepFile(k, st.st_size);
+}
+
+/**
+ * Adds a result to the memory level and drops the least recently used
+ * entries until it is within its bound again.
+ */
+void ResultCache::keepInMemory(uint64_t k, uint64_t input, const string &chain, Image &result) {
+  size_t bytes = (size_t) result.getRow() * result.getCol() * sizeof(float);
+  map<uint64_t, Entry>::iterator it = entries.find(k);
+
+  if (it != entries.end()) {
+    memoryBytes -= (size_t) it->second.result.getRow() * it->second.result.getCol() * sizeof(float);
+    memoryAge.erase(it->second.age);
+    entries.erase(it);
+  }
+  if (bytes > memoryLimit)
+    return;
+
+  Entry &entry = entries[k];
+  entry.result = result;
+  entry.chain = chain;
+  entry.input = input;
+  memoryAge.push_front(k);
+  entry.age = memoryAge.begin();
+  memoryBytes += bytes;
+
+  while (memoryBytes > memoryLimit) {
+    map<uint64_t, Entry>::iterator old = entries.find(memoryAge.back());
+    memoryBytes -= (size_t) old->second.result.getRow() * old->second.result.getCol() * sizeof(float);
+    entries.erase(old);
+    memoryAge.pop_back();
+  }
+}
+
+/**
+ * Adds a file to the disk level and deletes the least recently used files
+ * until it is within its bound again.
+ */
+void ResultCache::keepFile(uint64_t k, size_t bytes) {
+  diskAge.push_front(k);
+  files[k].bytes = bytes;
+  files[k].age = diskAge.begin();
+  diskBytes += bytes;
+
+  while (diskBytes > diskLimit && !diskAge.empty()) {
+    uint64_t old = diskAge.back();
+    unlink(fileName(old).c_str());
+    dropFile(old);
+  }
+}
+
+/**
+ * Marks a file as just used, in the disk LRU list and in its modification
+ * time, which orders the files when a later run picks them up.
+ */
+void ResultCache::touchFile(map<uint64_t, DiskEntry>::iterator f) {
+  utime(fileName(f->first).c_str(), NULL);
+  diskAge.splice(diskAge.begin(), diskAge, f->second.age);
+}
+
+void ResultCache::dropFile(uint64_t k) {
+  map<uint64_t, DiskEntry>::iterator f = files.find(k);
+
+  diskBytes -= f->second.bytes;
+  diskAge.erase(f->second.age);
+  files.erase(f);
+}
+
+/**
+ * Drops every entry of both levels and deletes the cache files. The
+ * counters are kept.
+ */
+void ResultCache::clear() {
+  entries.clear();
+  memoryAge.clear();
+  memoryBytes = 0;
+
+  while (!diskAge.empty()) {
+    uint64_t old = diskAge.back();
+    unlink(fileName(old).c_str());
+    dropFile(old);
+  }
+}
+
+long ResultCache::getHits() const {
+  return hits;
+}
+
+long ResultCache::getDiskHits() const {
+  return diskHits;
+}
+
+long ResultCache::getMisses() const {
+  return misses;
+}
+
+size_t ResultCache::getMemoryBytes() const {
+  return memoryBytes;
+}
+
+size_t ResultCache::getDiskBytes() const {
+  return diskBytes;
+}
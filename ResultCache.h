@@ -0,0 +1,79 @@
+/********************************************************************
+ * ResultCache.h - header file of the result cache which remembers the
+ *                 output of an operation chain for a given input
+ *
+ * Note:
+ *   An entry is keyed by the hash of the input pixels (Image::hash())
+ *   together with a text that names the chain and its parameters, such
+ *   as Pipeline::describe() or a string put together by the caller
+ *   ("gammaTransform(0.4) HistogramEqualization thresholdImage(127)").
+ *   The numbers in a caller's text are rewritten to one canonical form
+ *   first, so "0.4" and "0.40" give the same entry. Results are kept in
+ *   memory and, when a directory is given, on disk as .cache files that
+ *   later runs pick up again: a short header with the input hash and the
+ *   chain text, checked on every disk hit, followed by a PFM. Both levels
+ *   are bounded in bytes and drop the least recently used entries first.
+ *   The cache is not thread-safe.
+ *
+ ********************************************************************/
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include "Image.h"
+#include "Pipeline.h"
+
+class ResultCache {
+ public:
+  ResultCache(size_t memoryBytes = 256 << 20,  // bound of the in-memory level
+              const char *directory = NULL,    // on-disk level, NULL for none
+              size_t diskBytes = 1 << 30);     // bound of the on-disk level
+
+  bool lookup(const Image &in, const string &chain, Image &result);  // result of chain on in, if cached
+  void store(const Image &in, const string &chain, Image &result);   // remember result of chain on in
+  Image run(Pipeline &pipeline, Image &in);    // cached pipeline.run(in)
+  void clear();                                // drop every entry, on disk too
+
+  // counters and sizes
+  long getHits() const;                // lookups answered, from either level
+  long getDiskHits() const;            // those of them read from disk
+  long getMisses() const;              // lookups not answered
+  size_t getMemoryBytes() const;       // pixel bytes held in memory
+  size_t getDiskBytes() const;         // file bytes held on disk
+
+ private:
+  struct Entry {
+    Image result;		// the cached output
+    string chain;		// chain text, checked on lookup
+    uint64_t input;		// hash of the input
+    list<uint64_t>::iterator age;	// position in the memory LRU list
+  };
+
+  struct DiskEntry {
+    size_t bytes;		// file size
+    list<uint64_t>::iterator age;	// position in the disk LRU list
+  };
+
+  size_t memoryLimit, diskLimit;
+  size_t memoryBytes, diskBytes;
+  string directory;		// empty when there is no disk level
+  long hits, diskHits, misses;
+
+  map<uint64_t, Entry> entries;		// in-memory level
+  list<uint64_t> memoryAge;		// most recently used first
+  map<uint64_t, DiskEntry> files;	// on-disk level
+  list<uint64_t> diskAge;		// most recently used first
+
+  static uint64_t key(uint64_t input, const string &chain);
+  static string canonical(const string &chain);
+  static string header(uint64_t input, const string &chain);
+  string fileName(uint64_t k) const;
+  bool find(uint64_t input, const string &chain, Image &result);
+  void keep(uint64_t input, const string &chain, Image &result);
+  void keepInMemory(uint64_t k, uint64_t input, const string &chain, Image &result);
+  void keepFile(uint64_t k, size_t bytes);
+  void touchFile(map<uint64_t, DiskEntry>::iterator f);
+  void dropFile(uint64_t k);
+};
+
+#endif
@@ -0,0 +1,259 @@
+/**********************************************************
+ * TemplateMatcher.cpp - the template matcher which implements
+ *                       the member functions defined in
+ *                       TemplateMatcher.h
+ **********************************************************/
+
+#include "TemplateMatcher.h"
+
+using namespace std;
+
+typedef complex<float> cfloat;
+
+/**
+ * Smallest power of two that is not less than n.
+ */
+static int powerOfTwo(int n) {
+  int p = 1;
+
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+/**
+ * In-place radix-2 FFT of n (a power of two) values.
+ * @param twiddle exp(-2 pi i k / n) for k < n / 2.
+ */
+static void fft(cfloat *a, int n, const vector<cfloat> &twiddle) {
+  int i, j, k, len, bit;
+
+  for (i = 1, j = 0; i < n; i++) {
+    for (bit = n >> 1; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j)
+      swap(a[i], a[j]);
+  }
+
+  for (len = 2; len <= n; len <<= 1) {
+    int step = n / len;
+    for (i = 0; i < n; i += len)
+      for (k = 0; k < len / 2; k++) {
+        cfloat u = a[i + k];
+        cfloat v = a[i + k + len / 2] * twiddle[k * step];
+        a[i + k] = u + v;
+        a[i + k + len / 2] = u - v;
+      }
+  }
+}
+
+/**
+ * Twiddle factors of an n point FFT.
+ */
+static vector<cfloat> twiddles(int n) {
+  vector<cfloat> w(max(n / 2, 1));
+
+  for (int k = 0; k < n / 2; k++)
+    w[k] = cfloat(cos(-2 * M_PI * k / n), sin(-2 * M_PI * k / n));
+  return w;
+}
+
+/**
+ * Forward 2D FFT of a rows x cols buffer (both powers of two), in place.
+ * The inverse is taken by conjugating before and after. The columns are
+ * gathered TILESIZE at a time into contiguous lines, so the column pass reads
+ * the buffer row by row.
+ */
+static void fft2D(vector<cfloat> &a, int rows, int cols) {
+  vector<cfloat> wr = twiddles(cols), wc = twiddles(rows);
+  int r, c0;
+
+#pragma omp parallel for
+  for (r = 0; r < rows; r++)
+    fft(&a[(size_t) r * cols], cols, wr);
+
+#pragma omp parallel for schedule(dynamic)
+  for (c0 = 0; c0 < cols; c0 += TILESIZE) {
+    int width = min(TILESIZE, cols - c0);
+    vector<cfloat> lines((size_t) width * rows);
+    int rr, c;
+
+    for (rr = 0; rr < rows; rr++)
+      for (c = 0; c < width; c++)
+        lines[(size_t) c * rows + rr] = a[(size_t) rr * cols + c0 + c];
+    for (c = 0; c < width; c++)
+      fft(&lines[(size_t) c * rows], rows, wc);
+    for (rr = 0; rr < rows; rr++)
+      for (c = 0; c < width; c++)
+        a[(size_t) rr * cols + c0 + c] = lines[(size_t) c * rows + rr];
+  }
+}
+
+/**
+ * Constructor. Stores the template with its mean removed; the spectrum is
+ * made by the first match() call, once the frame size is known.
+ * @param templ The template.
+ */
+TemplateMatcher::TemplateMatcher(Image &templ) {
+  int rows, cols;
+  double mean = 0;
+
+  trows = templ.getRow();
+  tcols = templ.getCol();
+  if (trows <= 0 || tcols <= 0) {
+    cout << "TemplateMatcher: Template is empty\n";
+    exit(3);
+  }
+
+  for (rows = 0; rows < trows; rows++)
+    for (cols = 0; cols < tcols; cols++)
+      mean += templ(rows, cols);
+  mean /= (double) trows * tcols;
+
+  zeroMean.createImage(trows, tcols);
+  energy = 0;
+  for (rows = 0; rows < trows; rows++)
+    for (cols = 0; cols < tcols; cols++) {
+      zeroMean(rows, cols) = templ(rows, cols) - mean;
+      energy += zeroMean(rows, cols) * zeroMean(rows, cols);
+    }
+
+  fftRows = fftCols = 0;
+}
+
+/**
+ * Returns the template height.
+ * @return Number of rows.
+ */
+int TemplateMatcher::getRow() const {
+  return trows;
+}
+
+/**
+ * Returns the template width.
+ * @return Number of columns.
+ */
+int TemplateMatcher::getCol() const {
+  return tcols;
+}
+
+/**
+ * Tells whether a frame of the given size is matched through the FFT. The
+ * direct sum costs about outputs * template pixels multiply-adds, the FFT
+ * route about three padded transforms; the cheaper one wins.
+ * @param rows Frame height.
+ * @param cols Frame width.
+ * @return true for the FFT route, false for the direct one.
+ */
+bool TemplateMatcher::usesFFT(int rows, int cols) const {
+  double outputs = (double) (rows - trows + 1) * (cols - tcols + 1);
+  double padded = (double) powerOfTwo(rows) * powerOfTwo(cols);
+  double direct = outputs * trows * tcols;
+  double transform = 3 * 5 * padded * log2(padded);  // ~5 flops per complex butterfly point
+
+  return direct > transform;
+}
+
+/**
+ * Normalized cross-correlation of the template with every position of the
+ * frame where it fits entirely,
+ *     ncc(u, v) = sum (f - mean_f)(t - mean_t) / sqrt(sum (f - mean_f)^2 sum (t - mean_t)^2)
+ * with the sums taken over the window at (u, v). The numerator is the
+ * correlation of the frame with the zero-mean template (through the FFT for
+ * large searches, directly for small ones); the window energy comes from
+ * integral images of the frame and of its square. Flat windows score 0.
+ * @param frame The frame to search.
+ * @return The score map, (rows - trows + 1) x (cols - tcols + 1), in [-1, 1].
+ */
+Image TemplateMatcher::match(Image &frame) {
+  Image temp;
+  int nrows = frame.getRow(), ncols = frame.getCol();
+  int outRows = nrows - trows + 1, outCols = ncols - tcols + 1;
+  int rows, cols;
+  double n = (double) trows * tcols;
+
+  if (outRows <= 0 || outCols <= 0) {
+    cout << "TemplateMatcher::match: Template is larger than the frame\n";
+    exit(3);
+  }
+  temp.createImage(outRows, outCols);
+
+  // numerator: correlation with the zero-mean template
+  if (usesFFT(nrows, ncols)) {
+    int pr = powerOfTwo(nrows), pc = powerOfTwo(ncols);
+    size_t k;
+
+    if (pr != fftRows || pc != fftCols) {
+      spectrum.assign((size_t) pr * pc, cfloat(0, 0));
+      for (rows = 0; rows < trows; rows++)
+        for (cols = 0; cols < tcols; cols++)
+          spectrum[(size_t) rows * pc + cols] = zeroMean(rows, cols);
+      fft2D(spectrum, pr, pc);
+      for (k = 0; k < spectrum.size(); k++)
+        spectrum[k] = conj(spectrum[k]);
+      fftRows = pr;
+      fftCols = pc;
+    }
+
+    vector<cfloat> buf((size_t) pr * pc, cfloat(0, 0));
+    for (rows = 0; rows < nrows; rows++)
+      for (cols = 0; cols < ncols; cols++)
+        buf[(size_t) rows * pc + cols] = frame(rows, cols);
+    fft2D(buf, pr, pc);
+
+    // F * conj(T), then the inverse through conjugation
+    for (k = 0; k < buf.size(); k++)
+      buf[k] = conj(buf[k] * spectrum[k]);
+    fft2D(buf, pr, pc);
+
+    float scale = 1.0f / ((float) pr * pc);
+    for (rows = 0; rows < outRows; rows++)
+      for (cols = 0; cols < outCols; cols++)
+        temp(rows, cols) = buf[(size_t) rows * pc + cols].real() * scale;
+  }
+  else {
+#pragma omp parallel for private(cols)
+    for (rows = 0; rows < outRows; rows++)
+      for (cols = 0; cols < outCols; cols++) {
+        float sum = 0;
+        for (int i = 0; i < trows; i++) {
+          const float *f = &frame(rows + i, cols);
+          const float *t = &zeroMean(i, 0);
+          for (int j = 0; j < tcols; j++)
+            sum += f[j] * t[j];
+        }
+        temp(rows, cols) = sum;
+      }
+  }
+
+  // integral images of the frame and its square, one row and column of zeros in front
+  vector<double> s1((size_t) (nrows + 1) * (ncols + 1), 0.0), s2(s1.size(), 0.0);
+  for (rows = 0; rows < nrows; rows++) {
+    double row1 = 0, row2 = 0;
+    for (cols = 0; cols < ncols; cols++) {
+      double v = frame(rows, cols);
+      row1 += v;
+      row2 += v * v;
+      s1[(size_t) (rows + 1) * (ncols + 1) + cols + 1] = s1[(size_t) rows * (ncols + 1) + cols + 1] + row1;
+      s2[(size_t) (rows + 1) * (ncols + 1) + cols + 1] = s2[(size_t) rows * (ncols + 1) + cols + 1] + row2;
+    }
+  }
+
+#pragma omp parallel for private(cols)
+  for (rows = 0; rows < outRows; rows++)
+    for (cols = 0; cols < outCols; cols++) {
+      size_t a = (size_t) rows * (ncols + 1) + cols;
+      size_t b = a + tcols;
+      size_t c = a + (size_t) trows * (ncols + 1);
+      size_t d = c + tcols;
+      double sum = s1[d] - s1[b] - s1[c] + s1[a];
+      double sq = s2[d] - s2[b] - s2[c] + s2[a];
+      double var = sq - sum * sum / n;
+      double denom = sqrt(max(var, 0.0) * energy);
+
+      temp(rows, cols) = denom > 1e-6 * n ? temp(rows, cols) / denom : 0;
+    }
+
+  return temp;
+}
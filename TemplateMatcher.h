@@ -0,0 +1,40 @@
+/********************************************************************
+ * TemplateMatcher.h - header file of the template matcher which slides
+ *                     a template over frames and scores every position
+ *                     with the normalized cross-correlation
+ *
+ * Note:
+ *   Large searches compute the correlation through the 2D FFT and keep
+ *   the template spectrum between frames of the same size; small ones
+ *   are done directly. Either way the local frame energy comes from
+ *   integral images, so each position is normalized in constant time.
+ *
+ ********************************************************************/
+
+#ifndef TEMPLATEMATCHER_H
+#define TEMPLATEMATCHER_H
+
+#include "Image.h"
+#include <complex>
+
+class TemplateMatcher {
+ public:
+  TemplateMatcher(Image &templ);       // the template to look for
+
+  Image match(Image &frame);           // NCC map, (rows-trows+1) x (cols-tcols+1)
+  bool usesFFT(int rows, int cols) const;   // would a rows x cols frame go through the FFT
+
+  int getRow() const;                  // template height
+  int getCol() const;                  // template width
+
+ private:
+  int trows;		// template height
+  int tcols;		// template width
+  Image zeroMean;	// template minus its mean
+  double energy;	// sum of the squares of zeroMean
+  int fftRows;		// size the cached spectrum was made for, 0 if none
+  int fftCols;
+  vector< complex<float> > spectrum;	// FFT of zeroMean, zero padded
+};
+
+#endif
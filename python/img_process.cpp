@@ -0,0 +1,776 @@
+/**********************************************************
+ * img_process.cpp - Python bindings of the Image library
+ *
+ * The module exposes Image as img_process.Image. It supports the buffer
+ * protocol in both directions without copying:
+ *
+ *   a = numpy.zeros((480, 640), numpy.float32)
+ *   img = img_process.Image(a)      # img works on a's memory
+ *   out = img.gammaTransform(0.4)   # new Image, GIL released while it runs
+ *   b = numpy.asarray(out)          # b is out's buffer
+ *
+ * Wrapped buffers must be 2-D, float32 and writable, with contiguous rows;
+ * the rows themselves may be spaced further apart (a slice of a larger
+ * array). img.view(row, col, height, width) is a window of img that shares
+ * its pixels and keeps img alive.
+ * The member operations release the GIL while they run.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -fopenmp -shared -fPIC -I. $(python3-config --includes) \
+ *       python/img_process.cpp Image.cpp \
+ *       -o img_process$(python3-config --extension-suffix)
+ **********************************************************/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "Image.h"
+#include <errno.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Python object holding an Image
+typedef struct {
+  PyObject_HEAD
+  Image *img;		// the wrapped image
+  Py_buffer source;	// buffer the image borrows, if any
+  bool hasSource;	// source is held
+  PyObject *parent;	// image a view was taken from, if any
+  Py_ssize_t shape[2];	// exported shape and strides
+  Py_ssize_t strides[2];
+} PyImage;
+
+static PyTypeObject PyImageType;
+
+/**
+ * Wraps a freshly created Image into a Python object, taking ownership.
+ */
+static PyObject *wrapImage(Image *img) {
+  PyImage *self = PyObject_New(PyImage, &PyImageType);
+
+  if (self == NULL) {
+    delete img;
+    return NULL;
+  }
+  self->img = img;
+  self->hasSource = false;
+  self->parent = NULL;
+  return (PyObject *) self;
+}
+
+static bool isImage(PyObject *obj) {
+  return PyObject_TypeCheck(obj, &PyImageType);
+}
+
+/**
+ * Image(rows, cols) allocates a zero image,
+ * Image(buffer) wraps a 2-D float32 buffer without copying it.
+ */
+static PyObject *PyImage_new(PyTypeObject *type, PyObject *args, PyObject *) {
+  int rows, cols;
+  PyObject *obj;
+  PyImage *self;
+
+  if (PyArg_ParseTuple(args, "ii", &rows, &cols)) {
+    if (rows <= 0 || cols <= 0) {
+      PyErr_SetString(PyExc_ValueError, "Image: Index out of range.");
+      return NULL;
+    }
+    return wrapImage(new Image(rows, cols));
+  }
+  PyErr_Clear();
+
+  if (!PyArg_ParseTuple(args, "O", &obj))
+    return NULL;
+
+  self = (PyImage *) type->tp_alloc(type, 0);
+  if (self == NULL)
+    return NULL;
+  self->img = NULL;
+  self->hasSource = false;
+  self->parent = NULL;
+
+  if (PyObject_GetBuffer(obj, &self->source,
+                         PyBUF_STRIDES | PyBUF_FORMAT | PyBUF_WRITABLE) < 0) {
+    Py_DECREF(self);
+    return NULL;
+  }
+  self->hasSource = true;
+
+  if (self->source.ndim != 2 || self->source.itemsize != sizeof(float) ||
+      strcmp(self->source.format, "f") != 0 ||
+      self->source.shape[0] <= 0 || self->source.shape[1] <= 0) {
+    PyErr_SetString(PyExc_TypeError,
+                    "Image: buffer must be a non-empty 2-D float32 array");
+    Py_DECREF(self);
+    return NULL;
+  }
+  Py_ssize_t rowBytes = self->source.strides[0], pixel = sizeof(float);
+
+  if (self->source.strides[1] != pixel || rowBytes % pixel != 0 ||
+      abs(rowBytes) < self->source.shape[1] * pixel) {
+    PyErr_SetString(PyExc_TypeError, "Image: buffer rows must be contiguous");
+    Py_DECREF(self);
+    return NULL;
+  }
+
+  self->img = new Image(self->source.shape[0], self->source.shape[1],
+                        (float *) self->source.buf,
+                        rowBytes / pixel);
+  return (PyObject *) self;
+}
+
+static void PyImage_dealloc(PyImage *self) {
+  delete self->img;
+  if (self->hasSource)
+    PyBuffer_Release(&self->source);
+  Py_XDECREF(self->parent);
+  Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/**
+ * Buffer protocol: exports the pixels as a rows x cols float32 array.
+ * A view is only exported to consumers that accept strides.
+ */
+static int PyImage_getbuffer(PyImage *self, Py_buffer *view, int flags) {
+  Image *img = self->img;
+
+  if (img->getStride() != img->getCol() &&
+      (flags & PyBUF_STRIDES) != PyBUF_STRIDES) {
+    PyErr_SetString(PyExc_BufferError, "Image: a view is not contiguous");
+    view->obj = NULL;
+    return -1;
+  }
+
+  self->shape[0] = img->getRow();
+  self->shape[1] = img->getCol();
+  self->strides[0] = (Py_ssize_t) img->getStride() * (Py_ssize_t) sizeof(float);
+  self->strides[1] = sizeof(float);
+
+  view->obj = (PyObject *) self;
+  Py_INCREF(self);
+  view->buf = &(*img)(0, 0);
+  view->len = self->shape[0] * self->shape[1] * sizeof(float);
+  view->readonly = 0;
+  view->itemsize = sizeof(float);
+  view->format = (flags & PyBUF_FORMAT) ? (char *) "f" : NULL;
+  view->ndim = 2;
+  view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyBufferProcs PyImage_as_buffer = {
+  (getbufferproc) PyImage_getbuffer,
+  NULL,
+};
+
+/**
+ * Member operations without arguments, run with the GIL released.
+ */
+template <Image (Image::*op)()>
+static PyObject *unaryOp(PyImage *self, PyObject *) {
+  Image *result;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image((self->img->*op)());
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_thresholdImage(PyImage *self, PyObject *args) {
+  float threshold = 127.0, lowValue = 0.0, highValue = 255.0;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "|fff", &threshold, &lowValue, &highValue))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->thresholdImage(threshold, lowValue, highValue));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_gammaTransform(PyImage *self, PyObject *args) {
+  float gam;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "f", &gam))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->gammaTransform(gam));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+/**
+ * filterRows(kernel) / filterCols(kernel), kernel is a sequence of numbers.
+ */
+template <Image (Image::*op)(const float *, int)>
+static PyObject *filterOp(PyImage *self, PyObject *args) {
+  PyObject *obj, *seq;
+  vector<float> kernel;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "O", &obj))
+    return NULL;
+  seq = PySequence_Fast(obj, "kernel must be a sequence of numbers");
+  if (seq == NULL)
+    return NULL;
+  for (Py_ssize_t k = 0; k < PySequence_Fast_GET_SIZE(seq); k++)
+    kernel.push_back(PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, k)));
+  Py_DECREF(seq);
+  if (PyErr_Occurred())
+    return NULL;
+  if (kernel.size() % 2 == 0) {
+    PyErr_SetString(PyExc_ValueError, "kernel length must be odd");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image((self->img->*op)(&kernel[0], kernel.size()));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+/**
+ * labelComponents(connectivity=8, background=0) returns the label image and
+ * a list with one dict of statistics per component.
+ */
+static PyObject *PyImage_labelComponents(PyImage *self, PyObject *args) {
+  int connectivity = 8;
+  float background = 0.0;
+  vector<Region> regions;
+  Image *result;
+  PyObject *list;
+
+  if (!PyArg_ParseTuple(args, "|if", &connectivity, &background))
+    return NULL;
+  if (connectivity != 4 && connectivity != 8) {
+    PyErr_SetString(PyExc_ValueError, "connectivity must be 4 or 8");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->labelComponents(regions, connectivity, background));
+  Py_END_ALLOW_THREADS
+
+  list = PyList_New(regions.size());
+  for (size_t k = 0; k < regions.size(); k++) {
+    Region &r = regions[k];
+    PyList_SET_ITEM(list, k, Py_BuildValue(
+      "{s:i,s:i,s:(iiii),s:(dd),s:d}",
+      "label", r.label, "area", r.area,
+      "bbox", r.top, r.left, r.bottom, r.right,
+      "centroid", r.centroidRow, r.centroidCol, "sum", r.sum));
+  }
+  return Py_BuildValue("(NN)", wrapImage(result), list);
+}
+
+/**
+ * Reads a sequence of n numbers into values.
+ */
+static bool readFloats(PyObject *obj, float *values, int n) {
+  PyObject *seq = PySequence_Fast(obj, "expected a sequence of numbers");
+
+  if (seq == NULL)
+    return false;
+  if (PySequence_Fast_GET_SIZE(seq) != n) {
+    PyErr_Format(PyExc_ValueError, "expected %d numbers", n);
+    Py_DECREF(seq);
+    return false;
+  }
+  for (int k = 0; k < n; k++)
+    values[k] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, k));
+  Py_DECREF(seq);
+  return !PyErr_Occurred();
+}
+
+/**
+ * warpAffine(matrix[6]) / warpPerspective(matrix[9]),
+ * optional outRows, outCols, interpolation, fill.
+ */
+template <Image (Image::*op)(const float *, int, int, int, float), int n>
+static PyObject *warpOp(PyImage *self, PyObject *args) {
+  PyObject *obj;
+  float matrix[9], fill = 0.0;
+  int outRows = 0, outCols = 0, interpolation = BILINEAR;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "O|iiif", &obj, &outRows, &outCols, &interpolation, &fill) ||
+      !readFloats(obj, matrix, n))
+    return NULL;
+  if (interpolation < NEAREST || interpolation > BICUBIC) {
+    PyErr_SetString(PyExc_ValueError, "interpolation must be 0, 1 or 2");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image((self->img->*op)(matrix, outRows, outCols, interpolation, fill));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_rotate(PyImage *self, PyObject *args) {
+  float angle, fill = 0.0;
+  int interpolation = BILINEAR;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "f|if", &angle, &interpolation, &fill))
+    return NULL;
+  if (interpolation < NEAREST || interpolation > BICUBIC) {
+    PyErr_SetString(PyExc_ValueError, "interpolation must be 0, 1 or 2");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->rotate(angle, interpolation, fill));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+/**
+ * sobel() returns the magnitude and the quantized direction images.
+ */
+static PyObject *PyImage_sobel(PyImage *self, PyObject *) {
+  Image *result, *direction = new Image;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->sobel(*direction));
+  Py_END_ALLOW_THREADS
+
+  return Py_BuildValue("(NN)", wrapImage(result), wrapImage(direction));
+}
+
+static PyObject *PyImage_canny(PyImage *self, PyObject *args) {
+  float lowThreshold, highThreshold;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "ff", &lowThreshold, &highThreshold))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->canny(lowThreshold, highThreshold));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_gaussianBlur(PyImage *self, PyObject *args) {
+  float sigma;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "f", &sigma))
+    return NULL;
+  if (sigma < 0.5) {
+    PyErr_SetString(PyExc_ValueError, "sigma must be at least 0.5");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->gaussianBlur(sigma));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_bilateralFilter(PyImage *self, PyObject *args) {
+  float sigmaSpatial, sigmaRange, sampling = 1.0;
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "ff|f", &sigmaSpatial, &sigmaRange, &sampling))
+    return NULL;
+  if (sigmaSpatial <= 0 || sigmaRange <= 0 || sampling <= 0) {
+    PyErr_SetString(PyExc_ValueError, "sigmas and sampling must be positive");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->bilateralFilter(sigmaSpatial, sigmaRange, sampling));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_distanceTransform(PyImage *self, PyObject *args) {
+  float featureValue = 0.0;
+  int nearest = 0;
+  Image *result, *nearestRow = NULL, *nearestCol = NULL;
+
+  if (!PyArg_ParseTuple(args, "|fp", &featureValue, &nearest))
+    return NULL;
+  if (nearest) {
+    nearestRow = new Image;
+    nearestCol = new Image;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  if (nearest)
+    result = new Image(self->img->distanceTransform(*nearestRow, *nearestCol, featureValue));
+  else
+    result = new Image(self->img->distanceTransform(featureValue));
+  Py_END_ALLOW_THREADS
+
+  if (nearest)
+    return Py_BuildValue("(NNN)", wrapImage(result), wrapImage(nearestRow), wrapImage(nearestCol));
+  return wrapImage(result);
+}
+
+/**
+ * blockDCT(blockSize=8, quant=None) and
+ * blockIDCT(rows=0, cols=0, blockSize=8, quant=None); quant is a sequence
+ * of blockSize * blockSize steps.
+ */
+static PyObject *PyImage_blockDCT(PyImage *self, PyObject *args) {
+  int blockSize = 8;
+  PyObject *obj = Py_None;
+  float quant[256];
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "|iO", &blockSize, &obj))
+    return NULL;
+  if (blockSize != 8 && blockSize != 16) {
+    PyErr_SetString(PyExc_ValueError, "blockSize must be 8 or 16");
+    return NULL;
+  }
+  if (obj != Py_None && !readFloats(obj, quant, blockSize * blockSize))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->blockDCT(blockSize, obj != Py_None ? quant : NULL));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+static PyObject *PyImage_blockIDCT(PyImage *self, PyObject *args) {
+  int rows = 0, cols = 0, blockSize = 8;
+  PyObject *obj = Py_None;
+  float quant[256];
+  Image *result;
+
+  if (!PyArg_ParseTuple(args, "|iiiO", &rows, &cols, &blockSize, &obj))
+    return NULL;
+  if (blockSize != 8 && blockSize != 16) {
+    PyErr_SetString(PyExc_ValueError, "blockSize must be 8 or 16");
+    return NULL;
+  }
+  if (self->img->getRow() % blockSize != 0 || self->img->getCol() % blockSize != 0 ||
+      rows < 0 || cols < 0 || rows > self->img->getRow() || cols > self->img->getCol()) {
+    PyErr_SetString(PyExc_ValueError, "coefficients do not cover the requested size");
+    return NULL;
+  }
+  if (obj != Py_None && !readFloats(obj, quant, blockSize * blockSize))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = new Image(self->img->blockIDCT(rows, cols, blockSize, obj != Py_None ? quant : NULL));
+  Py_END_ALLOW_THREADS
+
+  return wrapImage(result);
+}
+
+/**
+ * waveletTransform(levels=1, wavelet=2) and its inverse work in place on
+ * the image (and on the buffer it wraps); wavelet is 0 for Haar, 1 for the
+ * integer CDF 5/3, 2 for CDF 9/7.
+ */
+static PyObject *PyImage_wavelet(PyImage *self, PyObject *args, bool inverse) {
+  int levels = 1, wavelet = CDF97;
+
+  if (!PyArg_ParseTuple(args, "|ii", &levels, &wavelet))
+    return NULL;
+  if (levels < 0 || wavelet < HAAR || wavelet > CDF97) {
+    PyErr_SetString(PyExc_ValueError, "levels must be >= 0 and wavelet 0, 1 or 2");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  if (inverse)
+    self->img->inverseWaveletTransform(levels, wavelet);
+  else
+    self->img->waveletTransform(levels, wavelet);
+  Py_END_ALLOW_THREADS
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyImage_waveletTransform(PyImage *self, PyObject *args) {
+  return PyImage_wavelet(self, args, false);
+}
+
+static PyObject *PyImage_inverseWaveletTransform(PyImage *self, PyObject *args) {
+  return PyImage_wavelet(self, args, true);
+}
+
+static PyObject *PyImage_view(PyImage *self, PyObject *args) {
+  int row, col, height, width;
+  PyImage *result;
+
+  if (!PyArg_ParseTuple(args, "iiii", &row, &col, &height, &width))
+    return NULL;
+  if (row < 0 || col < 0 || height <= 0 || width <= 0 ||
+      row + height > self->img->getRow() || col + width > self->img->getCol()) {
+    PyErr_SetString(PyExc_ValueError, "view: Window is outside the image.");
+    return NULL;
+  }
+
+  result = (PyImage *) wrapImage(new Image(height, width, &(*self->img)(row, col),
+                                           self->img->getStride()));
+  if (result == NULL)
+    return NULL;
+  Py_INCREF(self);
+  result->parent = (PyObject *) self;
+  return (PyObject *) result;
+}
+
+static PyObject *PyImage_getMaximum(PyImage *self, PyObject *) {
+  return PyFloat_FromDouble(self->img->getMaximum());
+}
+
+static PyObject *PyImage_getMinimum(PyImage *self, PyObject *) {
+  return PyFloat_FromDouble(self->img->getMinimum());
+}
+
+// Raises OSError for a file that could not be written, from errno when
+// the system gave a reason
+static PyObject *writeError(const char *fname) {
+  if (errno != 0)
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, fname);
+  PyErr_Format(PyExc_OSError, "can't write image: '%s'", fname);
+  return NULL;
+}
+
+static PyObject *PyImage_writeImage(PyImage *self, PyObject *args) {
+  char *fname;
+  int flag = 0;
+
+  if (!PyArg_ParseTuple(args, "s|p", &fname, &flag))
+    return NULL;
+  errno = 0;
+  if (!self->img->writeImage(fname, flag))
+    return writeError(fname);
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyImage_writeFloatImage(PyImage *self, PyObject *args) {
+  char *fname;
+  const char *metadata = "";
+  Py_ssize_t length = 0;
+
+  if (!PyArg_ParseTuple(args, "s|s#", &fname, &metadata, &length))
+    return NULL;
+  errno = 0;
+  if (!self->img->writeFloatImage(fname, "", string(metadata, length)))
+    return writeError(fname);
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyImage_readImage(PyObject *, PyObject *args) {
+  char *fname;
+  Image *img;
+
+  if (!PyArg_ParseTuple(args, "s", &fname))
+    return NULL;
+  if (access(fname, R_OK) != 0)
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, fname);
+  img = new Image;
+  if (!img->readImage(fname)) {
+    delete img;
+    PyErr_Format(PyExc_OSError, "not an 8-bit PGM image: '%s'", fname);
+    return NULL;
+  }
+  return wrapImage(img);
+}
+
+static PyObject *PyImage_readFloatImage(PyObject *, PyObject *args) {
+  char *fname;
+  int withMetadata = 0;
+  string metadata;
+  Image *img;
+  PyObject *wrapped;
+
+  if (!PyArg_ParseTuple(args, "s|p", &fname, &withMetadata))
+    return NULL;
+  if (access(fname, R_OK) != 0)
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, fname);
+  img = new Image;
+  if (!img->readFloatImage(fname, 0, &metadata)) {
+    delete img;
+    PyErr_Format(PyExc_OSError, "not a single channel PFM image: '%s'", fname);
+    return NULL;
+  }
+  wrapped = wrapImage(img);
+  if (!withMetadata || wrapped == NULL)
+    return wrapped;
+  return Py_BuildValue("(Ns#)", wrapped, metadata.data(), (Py_ssize_t) metadata.size());
+}
+
+static PyMethodDef PyImage_methods[] = {
+  {"thresholdImage", (PyCFunction) PyImage_thresholdImage, METH_VARARGS,
+   "thresholdImage(threshold=127, lowValue=0, highValue=255)"},
+  {"negativeImg", (PyCFunction) unaryOp<&Image::negativeImg>, METH_NOARGS, NULL},
+  {"logTransform", (PyCFunction) unaryOp<&Image::logTransform>, METH_NOARGS, NULL},
+  {"gammaTransform", (PyCFunction) PyImage_gammaTransform, METH_VARARGS,
+   "gammaTransform(gam)"},
+  {"HistogramEqualization", (PyCFunction) unaryOp<&Image::HistogramEqualization>,
+   METH_NOARGS, NULL},
+  {"DFT", (PyCFunction) unaryOp<&Image::DFT>, METH_NOARGS, NULL},
+  {"IDFT", (PyCFunction) unaryOp<&Image::IDFT>, METH_NOARGS, NULL},
+  {"transpose", (PyCFunction) unaryOp<&Image::transpose>, METH_NOARGS, NULL},
+  {"filterRows", (PyCFunction) filterOp<&Image::filterRows>, METH_VARARGS,
+   "filterRows(kernel)"},
+  {"filterCols", (PyCFunction) filterOp<&Image::filterCols>, METH_VARARGS,
+   "filterCols(kernel)"},
+  {"labelComponents", (PyCFunction) PyImage_labelComponents, METH_VARARGS,
+   "labelComponents(connectivity=8, background=0) -> (labels, regions)"},
+  {"warpAffine", (PyCFunction) warpOp<&Image::warpAffine, 6>, METH_VARARGS,
+   "warpAffine(matrix, outRows=0, outCols=0, interpolation=1, fill=0)"},
+  {"warpPerspective", (PyCFunction) warpOp<&Image::warpPerspective, 9>, METH_VARARGS,
+   "warpPerspective(matrix, outRows=0, outCols=0, interpolation=1, fill=0)"},
+  {"rotate", (PyCFunction) PyImage_rotate, METH_VARARGS,
+   "rotate(angle, interpolation=1, fill=0)"},
+  {"sobel", (PyCFunction) PyImage_sobel, METH_NOARGS,
+   "sobel() -> (magnitude, direction)"},
+  {"canny", (PyCFunction) PyImage_canny, METH_VARARGS,
+   "canny(lowThreshold, highThreshold)"},
+  {"gaussianBlur", (PyCFunction) PyImage_gaussianBlur, METH_VARARGS,
+   "gaussianBlur(sigma)"},
+  {"bilateralFilter", (PyCFunction) PyImage_bilateralFilter, METH_VARARGS,
+   "bilateralFilter(sigmaSpatial, sigmaRange, sampling=1)"},
+  {"distanceTransform", (PyCFunction) PyImage_distanceTransform, METH_VARARGS,
+   "distanceTransform(featureValue=0, nearest=False) -> distance, or (distance, rows, cols)"},
+  {"blockDCT", (PyCFunction) PyImage_blockDCT, METH_VARARGS,
+   "blockDCT(blockSize=8, quant=None) -> blockwise DCT coefficients"},
+  {"blockIDCT", (PyCFunction) PyImage_blockIDCT, METH_VARARGS,
+   "blockIDCT(rows=0, cols=0, blockSize=8, quant=None) -> reconstructed image"},
+  {"waveletTransform", (PyCFunction) PyImage_waveletTransform, METH_VARARGS,
+   "waveletTransform(levels=1, wavelet=2), in place"},
+  {"inverseWaveletTransform", (PyCFunction) PyImage_inverseWaveletTransform, METH_VARARGS,
+   "inverseWaveletTransform(levels=1, wavelet=2), in place"},
+  {"view", (PyCFunction) PyImage_view, METH_VARARGS,
+   "view(row, col, height, width) -> Image sharing the pixels of the window"},
+  {"getMaximum", (PyCFunction) PyImage_getMaximum, METH_NOARGS, NULL},
+  {"getMinimum", (PyCFunction) PyImage_getMinimum, METH_NOARGS, NULL},
+  {"writeImage", (PyCFunction) PyImage_writeImage, METH_VARARGS,
+   "writeImage(fname, rescale=False)"},
+  {"writeFloatImage", (PyCFunction) PyImage_writeFloatImage, METH_VARARGS,
+   "writeFloatImage(fname, metadata='')"},
+  {"readImage", (PyCFunction) PyImage_readImage, METH_VARARGS | METH_STATIC,
+   "readImage(fname) -> Image"},
+  {"readFloatImage", (PyCFunction) PyImage_readFloatImage, METH_VARARGS | METH_STATIC,
+   "readFloatImage(fname, withMetadata=False) -> Image, or (Image, metadata)"},
+  {NULL, NULL, 0, NULL}
+};
+
+static PyObject *PyImage_getRow(PyImage *self, void *) {
+  return PyLong_FromLong(self->img->getRow());
+}
+
+static PyObject *PyImage_getCol(PyImage *self, void *) {
+  return PyLong_FromLong(self->img->getCol());
+}
+
+static PyGetSetDef PyImage_getset[] = {
+  {(char *) "rows", (getter) PyImage_getRow, NULL, NULL, NULL},
+  {(char *) "cols", (getter) PyImage_getCol, NULL, NULL, NULL},
+  {NULL, NULL, NULL, NULL, NULL}
+};
+
+/**
+ * Arithmetic operators, Image with Image or Image with a number,
+ * the same as the C++ operators.
+ */
+template <int kind>
+static PyObject *arithmetic(PyObject *a, PyObject *b) {
+  Image *result = NULL;
+  Image *img, *other;
+  double s;
+
+  if (!isImage(a))
+    Py_RETURN_NOTIMPLEMENTED;
+  img = ((PyImage *) a)->img;
+
+  if (isImage(b)) {
+    other = ((PyImage *) b)->img;
+    if (other->getRow() != img->getRow() || other->getCol() != img->getCol()) {
+      PyErr_SetString(PyExc_ValueError, "Images are not of the same size");
+      return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    switch (kind) {
+    case 0: result = new Image(*img + *other); break;
+    case 1: result = new Image(*img - *other); break;
+    case 2: result = new Image(*img * *other); break;
+    default: result = new Image(*img / *other); break;
+    }
+    Py_END_ALLOW_THREADS
+    return wrapImage(result);
+  }
+
+  s = PyFloat_AsDouble(b);
+  if (s == -1.0 && PyErr_Occurred()) {
+    PyErr_Clear();
+    Py_RETURN_NOTIMPLEMENTED;
+  }
+  Py_BEGIN_ALLOW_THREADS
+  switch (kind) {
+  case 0: result = new Image(*img + s); break;
+  case 1: result = new Image(*img - s); break;
+  case 2: result = new Image(*img * s); break;
+  default: result = new Image(*img / s); break;
+  }
+  Py_END_ALLOW_THREADS
+  return wrapImage(result);
+}
+
+static PyNumberMethods PyImage_as_number;
+
+static PyModuleDef img_process_module = {
+  PyModuleDef_HEAD_INIT, "img_process",
+  "Python bindings of the Image library.", -1, NULL,
+};
+
+PyMODINIT_FUNC PyInit_img_process(void) {
+  PyObject *m;
+
+  PyImage_as_number.nb_add = arithmetic<0>;
+  PyImage_as_number.nb_subtract = arithmetic<1>;
+  PyImage_as_number.nb_multiply = arithmetic<2>;
+  PyImage_as_number.nb_true_divide = arithmetic<3>;
+
+  PyImageType.tp_name = "img_process.Image";
+  PyImageType.tp_basicsize = sizeof(PyImage);
+  PyImageType.tp_dealloc = (destructor) PyImage_dealloc;
+  PyImageType.tp_as_number = &PyImage_as_number;
+  PyImageType.tp_as_buffer = &PyImage_as_buffer;
+  PyImageType.tp_flags = Py_TPFLAGS_DEFAULT;
+  PyImageType.tp_doc = "Image(rows, cols) or Image(float32 2-D buffer), zero-copy";
+  PyImageType.tp_methods = PyImage_methods;
+  PyImageType.tp_getset = PyImage_getset;
+  PyImageType.tp_new = PyImage_new;
+
+  if (PyType_Ready(&PyImageType) < 0)
+    return NULL;
+
+  m = PyModule_Create(&img_process_module);
+  if (m == NULL)
+    return NULL;
+
+  Py_INCREF(&PyImageType);
+  if (PyModule_AddObject(m, "Image", (PyObject *) &PyImageType) < 0) {
+    Py_DECREF(&PyImageType);
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}